@@ -4,12 +4,22 @@
  **/
 
 #include "stdio.h"
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <malloc.h>
+#include <mutex>
 #include <new>
 #include <strsafe.h>
+#include <thread>
+#if defined(_M_X64) || defined(__x86_64__)
+// SSE2 is part of x64, its non-temporal stores clear large ranges without going through the cache
+#include <emmintrin.h>
+#endif
 #include <windows.h>
 
 // Use (void) to silent unused warnings.
@@ -204,12 +214,10 @@ namespace Tests
     {
         void *mem = allocator.Allocate(size, alignment);
         uint8_t *mem_pointer = reinterpret_cast<uint8_t *>(mem);
-        mem_pointer += sizeof(uintptr_t);
-        for (int i = 0; i < 1; i++)
-        {
-            *mem_pointer = 0xAA;
-            mem_pointer--;
-        }
+        // Highest byte of the content size, which is placed right before the previous address
+        mem_pointer -= sizeof(uintptr_t);
+        mem_pointer--;
+        *mem_pointer = 0xAA;
 
         allocator.Free(mem);
 
@@ -248,7 +256,8 @@ namespace Tests
         void *mem = allocator.Allocate(size, alignment);
         uint8_t *mem_pointer = reinterpret_cast<uint8_t *>(mem);
         mem_pointer -= sizeof(uintptr_t);
-        *mem_pointer = *(mem_pointer + alignment);
+        // Flip the lowest byte so the address changes for sure
+        *mem_pointer = uint8_t(~*mem_pointer);
 
         allocator.Free(mem);
 
@@ -267,7 +276,8 @@ namespace Tests
         void *mem = allocator.AllocateBack(size, alignment);
         uint8_t *mem_pointer = reinterpret_cast<uint8_t *>(mem);
         mem_pointer -= sizeof(uintptr_t);
-        *mem_pointer = *(mem_pointer + alignment);
+        // Flip the lowest byte so the address changes for sure
+        *mem_pointer = uint8_t(~*mem_pointer);
 
         allocator.FreeBack(mem);
 
@@ -350,543 +360,3606 @@ namespace Tests
         return true;
     }
 
-} // namespace Tests
+    // Checks if a released arena is handed out again, empty, and that an exhausted pool returns nullptr
+    template <class P> bool VerifyArenaPoolReuse(P &pool, size_t size, size_t alignment)
+    {
+        auto *arena = pool.Acquire();
+        if (arena == nullptr)
+        {
+            printf("[Error]: Pool returned nullptr!\n");
+            return false;
+        }
+        void *mem = arena->Allocate(size, alignment);
 
-// If set to 1, Free() and FreeBack() should assert if the memory canaries are corrupted
-#define WITH_DEBUG_CANARIES 1
+        for (size_t i = 1; i < pool.GetArenaCount(); i++)
+        {
+            pool.Acquire();
+        }
+        if (pool.Acquire() != nullptr)
+        {
+            printf("[Error]: Pool handed out more arenas than it owns!\n");
+            return false;
+        }
 
-// Using mainly: https://docs.microsoft.com/en-us/windows/win32/memory/reserving-and-committing-memory
-// Additional info used:
-// https://social.msdn.microsoft.com/Forums/vstudio/en-US/117512d6-c485-471e-b48b-30a610881129/how-to-use-virtualalloc?forum=vcgeneral
-// https://docs.microsoft.com/en-us/windows/win32/api/memoryapi/nf-memoryapi-virtualalloc
-// https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getsysteminfo
-// https://docs.microsoft.com/en-us/windows/win32/memory/memory-protection-constants
-#define USING_VIRTUAL_MEMORY 1
+        pool.Release(arena);
+        auto *reacquired = pool.Acquire();
+        if (reacquired != arena || reacquired->Allocate(size, alignment) != mem)
+        {
+            printf("[Error]: Released arena was not reset!\n");
+            return false;
+        }
 
-#if WITH_DEBUG_CANARIES
-static const uint16_t CANARY = 0x0DD0;
-#endif
+        return true;
+    }
 
-// Placed in front of the data
-struct Metadata
-{
-    Metadata(size_t content_size, uintptr_t previous_address)
-        : content_size(content_size), previous_address(previous_address)
+    // Checks if trimming an idle arena gives its pages back while it stays usable
+    template <class P> bool VerifyArenaPoolTrim(P &pool, size_t size, size_t alignment)
     {
-    }
-    // Size of the content
-    size_t content_size;
-    // Address of the previous data (allocated before this data)
-    uintptr_t previous_address;
-};
+        auto *arena = pool.Acquire();
+        arena->Allocate(size, alignment);
+        arena->AllocateBack(size, alignment);
+        size_t committed = arena->GetCommittedSize();
+        pool.Release(arena);
+        pool.Trim();
+
+        if (arena->GetCommittedSize() >= committed)
+        {
+            printf("[Error]: Trim did not decommit anything!\n");
+            return false;
+        }
 
-/**
- * You work on your DoubleEndedStackAllocator. Stick to the provided interface, this is
- * necessary for testing your assignment in the end. Don't remove or rename the public
- * interface of the allocator. Also don't add any additional initialization code, the
- * allocator needs to work after it was created and its constructor was called. You can
- * add additional public functions but those should only be used for your own testing.
- **/
+        arena = pool.Acquire();
+        if (arena->Allocate(size, alignment) == nullptr || arena->AllocateBack(size, alignment) == nullptr)
+        {
+            printf("[Error]: Trimmed arena is not usable!\n");
+            return false;
+        }
 
-class DoubleEndedStackAllocator
-{
-  public:
-    DoubleEndedStackAllocator(size_t max_size)
+        return true;
+    }
+
+    // Checks if the hard limit of a commit budget makes allocations fail and the soft limit invokes the callback
+    template <class A, class B> bool VerifyCommitBudget(A &allocator, B &budget, size_t size, size_t alignment)
     {
-#if USING_VIRTUAL_MEMORY
-        // Look up page size
-        SYSTEM_INFO system_info;
-        GetSystemInfo(&system_info);
-        page_size = system_info.dwPageSize;
+        bool above_soft_limit = false;
+        budget.SetPressureCallback([](B &, bool above, void *user_data) { *static_cast<bool *>(user_data) = above; },
+                                   &above_soft_limit);
+        allocator.SetCommitBudget(&budget);
 
-        // If given size is smaller than a page, use page size instead
-        max_size = max(max_size, page_size);
-        // Reserve the max size and set its memory protection constants to no access so errors are noticable
-        void *begin = VirtualAlloc(NULL, max_size, MEM_RESERVE, PAGE_NOACCESS);
-        assertm(begin != nullptr, "Memory reservation failed!");
-#else
-        void *begin = malloc(max_size);
-        assertm(begin != nullptr, "Malloc failed!");
-#endif
-        reserved_size = max_size;
-        // If we have a beginning, set allocator as valid
-        if (begin != nullptr)
+        size_t allocations = 0;
+        while (allocator.Allocate(size, alignment) != nullptr)
         {
-            is_valid = true;
+            allocations++;
         }
 
-        // These values will stay constant throughout the object's lifetime
-        allocation_begin = reinterpret_cast<uintptr_t>(begin);
-        allocation_end = allocation_begin + max_size;
+        bool passed = true;
+        if (allocations == 0 || allocator.GetCommittedSize() > budget.GetHardLimit())
+        {
+            printf("[Error]: Hard limit was not respected!\n");
+            passed = false;
+        }
+        else if (!above_soft_limit)
+        {
+            printf("[Error]: Pressure callback was not invoked!\n");
+            passed = false;
+        }
 
-        // Initialize the current addresses to the edges of the allocated space
-        Reset();
+        allocator.Reset();
+        allocator.Trim(0);
+        if (passed && (budget.GetCommitted() != 0 || above_soft_limit))
+        {
+            printf("[Error]: Decommitted pages were not released from the budget!\n");
+            passed = false;
+        }
+
+        // Neither the budget nor the allocator may point to this test's locals once it returns
+        budget.SetPressureCallback(nullptr, nullptr);
+        allocator.SetCommitBudget(&B::Global());
+        return passed;
     }
-    ~DoubleEndedStackAllocator(void)
+
+    // Checks if pages committed by one end and reused by the other one are only charged once, so a budget as large as
+    // the allocator never refuses an allocation
+    template <class A, class B> bool VerifyCommitBudgetSharedPages(A &allocator, B &budget, size_t alignment)
     {
-#if USING_VIRTUAL_MEMORY
-        VirtualFree(reinterpret_cast<void *>(allocation_begin), 0, MEM_RELEASE);
-#else
-        free(reinterpret_cast<void *>(allocation_begin));
-#endif
-    }
+        allocator.SetCommitBudget(&budget);
+        size_t size = allocator.GetReservedSize() / 8 * 7;
 
-    // Copy and Move Constructors / Assignment Operators are explicitly deleted.
-    // There are some ways to get them to work, but they all require the user to be very cautious and might be
-    // unexpected (especially when called implicitly), so we think it's best to keep the user from invoking them
-    // entirely.
-    DoubleEndedStackAllocator(const DoubleEndedStackAllocator &other) = delete;             // Copy Constructor
-    DoubleEndedStackAllocator(DoubleEndedStackAllocator &&other) = delete;                  // Move Constructor
-    DoubleEndedStackAllocator &operator=(const DoubleEndedStackAllocator &other) = delete;  // Copy Assignment Operator
-    DoubleEndedStackAllocator &operator=(const DoubleEndedStackAllocator &&other) = delete; // Move Assignment Operator
+        allocator.Free(allocator.Allocate(size, alignment));
+        void *mem = allocator.TryAllocateBack(size, alignment);
+        bool passed = true;
+        if (mem == nullptr || budget.GetCommitted() != allocator.GetCommittedSize())
+        {
+            printf("[Error]: Pages committed by both ends were charged twice!\n");
+            passed = false;
+        }
 
-    // Returns `false` if the Allocator is in an unusable state, e.g. because the initial memory allocation failed.
-    bool IsValid()
-    {
-        return is_valid;
+        if (mem != nullptr)
+        {
+            allocator.FreeBack(mem);
+        }
+        allocator.SetCommitBudget(&B::Global());
+        return passed;
     }
 
-    /**
-     * Memory layout of content is:
-     * ...[previous Content][previous Canary][   ][Canary][Metadata][Content][Canary][   ][next
-     *Canary][nextMetadata].... Pointer points to border of Metadata and Content. [Content] Block will be on aligned
-     *adress. This means there might be unused space (note the [   ] blocks above) before Metadata.
-     **/
-
-    // Alignment must be a power of two.
-    // Returns a nullptr if there is not enough memory left.
-    void *Allocate(size_t size, size_t alignment)
+    // Checks if allocations which don't fit are served by the fallback, and if freeing them keeps the LIFO order intact
+    template <class A, class F> bool VerifyOverflowFallback(A &allocator, const F &fallback, size_t alignment)
     {
-        if (reinterpret_cast<void *>(next_free_address_front) == nullptr)
+        allocator.SetOverflowFallback(fallback);
+        size_t size = allocator.GetReservedSize();
+
+        void *mem = allocator.Allocate(size / 3, alignment);
+        void *overflow = allocator.Allocate(size, alignment);
+        void *mem2 = allocator.Allocate(size / 3, alignment);
+        void *overflow_back = allocator.AllocateBack(size / 2, alignment);
+        if (mem == nullptr || overflow == nullptr || mem2 == nullptr || overflow_back == nullptr)
         {
-            assertm(false, "Allocator did not allocate any memory");
-            return nullptr;
+            printf("[Error]: Allocator returned nullptr!\n");
+            return false;
         }
-        // Check for power of two
-        if (!alignment || (alignment & (alignment - 1)))
+        if (reinterpret_cast<uintptr_t>(overflow) % alignment != 0)
         {
-            assertm(false, "Allocation only works with an alignement of the power of two");
-            return nullptr;
+            printf("[Error]: Fallback block is not aligned!\n");
+            return false;
         }
+        memset(overflow, 0xAA, size);
 
-        uintptr_t offset_address = next_free_address_front;
-#if WITH_DEBUG_CANARIES
-        // Making sure there is enough space to write canary
-        offset_address += sizeof(CANARY);
-#endif
-        // Making sure there is enough space to write metadata
-        offset_address += sizeof(Metadata);
+        allocator.FreeBack(overflow_back);
+        allocator.Free(mem2);
+        allocator.Free(overflow);
+        allocator.Free(mem);
+        if (!allocator.IsValid() || allocator.Allocate(size / 3, alignment) != mem)
+        {
+            printf("[Error]: Freeing the fallback blocks broke the stack!\n");
+            return false;
+        }
 
-        uintptr_t aligned_address = Align(offset_address, alignment);
+        const auto &front = allocator.GetFallbackStatsFront();
+        const auto &back = allocator.GetFallbackStatsBack();
+        if (front.allocation_count != 1 || front.total_bytes != size || front.live_bytes != 0 ||
+            back.allocation_count != 1 || back.largest_allocation != size / 2)
+        {
+            printf("[Error]: Fallback statistics are wrong!\n");
+            return false;
+        }
 
-#if WITH_DEBUG_CANARIES
-        if (aligned_address + size + sizeof(CANARY) > next_free_address_back)
-#else
-        if (aligned_address + size > next_free_address_back)
-#endif
+        // Blocks still alive on Reset() go back to the fallback as well
+        allocator.Allocate(size, alignment);
+        allocator.AllocateBack(size, alignment);
+        allocator.Reset();
+        if (front.live_bytes != 0 || back.live_bytes != 0)
         {
-            // Overlap -> out of space!
-            assertm(false, "Allocate failed due to lack of space!");
-            return nullptr;
+            printf("[Error]: Reset did not free the fallback blocks!\n");
+            return false;
         }
 
-#if USING_VIRTUAL_MEMORY
-#if WITH_DEBUG_CANARIES
+        return true;
+    }
 
-        // While there is not enough space left on the current page
-        while (aligned_address + size + sizeof(CANARY) > page_start_front + page_size)
-#else
-        while (aligned_address + size > page_start_front + page_size)
-#endif
+    // Checks if allocations whose pages the commit budget doesn't allow are served by the fallback instead of failing
+    template <class A, class B, class F>
+    bool VerifyCommitBudgetFallback(A &allocator, B &budget, const F &fallback, size_t size, size_t alignment)
+    {
+        allocator.SetCommitBudget(&budget);
+        allocator.SetOverflowFallback(fallback);
+
+        // Asks for about twice as much as the budget allows
+        void *blocks[32];
+        size_t count = min(2 * budget.GetHardLimit() / size, sizeof(blocks) / sizeof(blocks[0]));
+        size_t allocated = 0;
+        bool passed = true;
+        for (; allocated < count; allocated++)
         {
-            // Try to commit another page
-            if (!VirtualAlloc(reinterpret_cast<void *>(page_start_front + page_size), page_size, MEM_COMMIT,
-                              PAGE_READWRITE))
+            blocks[allocated] = allocator.Allocate(size, alignment);
+            if (blocks[allocated] == nullptr)
             {
-                // edgecase: there is enough space for the allocation from the current page on the other side but not
-                // enough space to commit another page from this side
-                // if that is not the case something else went wrong
-                if (page_start_front + page_size < page_start_back)
-                {
-                    assertm(false, "Front page commit failed!");
-                    return nullptr;
-                }
+                printf("[Error]: Allocation over the hard limit was not served by the fallback!\n");
+                passed = false;
+                break;
             }
-
-            page_start_front += page_size;
         }
-#endif // USING_VIRTUAL_MEMORY
-
-        // Allocate using correct offeset address (provide prev address)
-        uintptr_t allocation_address = AllocateInternal(size, aligned_address, last_data_begin_address_front);
-
-        // Update internal address pointers
-        last_data_begin_address_front = allocation_address;
-        next_free_address_front = allocation_address + size;
-#if WITH_DEBUG_CANARIES
-        // Add canary size to get correct free address
-        next_free_address_front += sizeof(CANARY);
-#endif
+        if (passed && (allocator.GetCommittedSize() > budget.GetHardLimit() ||
+                       allocator.GetFallbackStatsFront().allocation_count == 0))
+        {
+            printf("[Error]: Hard limit was not respected!\n");
+            passed = false;
+        }
 
-        return reinterpret_cast<void *>(allocation_address);
+        while (allocated > 0)
+        {
+            allocated--;
+            allocator.Free(blocks[allocated]);
+        }
+        allocator.SetCommitBudget(&B::Global());
+        return passed;
     }
 
-    // Alignment must be a power of two.
-    // Returns a nullptr if there is not enough memory left.
-    void *AllocateBack(size_t size, size_t alignment)
+    // Checks if allocations spanning many pages work and stay usable, whatever pages the allocator got
+    template <class A> bool VerifyLargeAllocations(A &allocator, size_t alignment)
     {
-        if (reinterpret_cast<void *>(next_free_address_back) == nullptr)
+        size_t size = allocator.GetReservedSize() / 3;
+        uint8_t *mem = static_cast<uint8_t *>(allocator.Allocate(size, alignment));
+        uint8_t *mem2 = static_cast<uint8_t *>(allocator.AllocateBack(size, alignment));
+        if (mem == nullptr || mem2 == nullptr)
         {
-            assertm(false, "Allocator did not allocate any memory");
-            return nullptr;
+            printf("[Error]: Allocator returned nullptr!\n");
+            return false;
         }
-        // Check for power of two
 
-        if (!alignment || (alignment & (alignment - 1)))
+        // Touches every page, uncommitted ones would crash here
+        memset(mem, 0xAA, size);
+        memset(mem2, 0x55, size);
+        if (allocator.GetCommittedSize() < 2 * size)
         {
-            assertm(false, "Allocation only works with an alignement of the power of two");
-            return nullptr;
+            printf("[Error]: Committed size is too small!\n");
+            return false;
         }
 
-        uintptr_t offset_address = next_free_address_back;
-
-#if WITH_DEBUG_CANARIES
-        // Making sure there is enough space to write canary
-        offset_address -= sizeof(CANARY);
-#endif
-
-        // Making sure there is enough space for the content
-        offset_address -= size;
+        allocator.FreeBack(mem2);
+        allocator.Free(mem);
+        return true;
+    }
 
-        uintptr_t aligned_address = Align(offset_address, -int64_t(alignment));
-#if WITH_DEBUG_CANARIES
-        if (aligned_address - sizeof(Metadata) - sizeof(CANARY) < next_free_address_front)
-#else
-        if (aligned_address - sizeof(Metadata) < next_free_address_front)
-#endif
+    // Checks if memory handed to the reclaimer by Reset() is clean when it is allocated again, from both sides
+    template <class A, class R> bool VerifyBackgroundReclaim(A &allocator, R &reclaimer, typename R::Mode mode)
+    {
+        allocator.SetReclaimer(&reclaimer, mode);
+        size_t size = allocator.GetReservedSize() / 3;
+        for (int round = 0; round < 3; round++)
         {
-            // Overlap -> out of space!
-            assertm(false, "AllocateBack failed due to lack of space!");
-            return nullptr;
-        }
+            uint8_t *mem = static_cast<uint8_t *>(allocator.Allocate(size, 8));
+            uint8_t *mem2 = static_cast<uint8_t *>(allocator.AllocateBack(size, 8));
+            if (mem == nullptr || mem2 == nullptr)
+            {
+                printf("[Error]: Allocator returned nullptr!\n");
+                return false;
+            }
 
-#if USING_VIRTUAL_MEMORY
-#if WITH_DEBUG_CANARIES
-        // while there is not enough space left on the current page
-        while (aligned_address - sizeof(Metadata) - sizeof(CANARY) < page_start_back)
-#else
-        while (aligned_address - sizeof(Metadata) > page_start_back)
-#endif
-        {
-            // commit another page
-            if (!VirtualAlloc(reinterpret_cast<void *>(page_start_back - page_size), page_size, MEM_COMMIT,
-                              PAGE_READWRITE))
+            for (size_t i = 0; i < size; i++)
             {
-                // edgecase: there is enough space for the allocation from the current page on the other side but not
-                // enough space to commit another page from this side
-                // if that is not the case something else went wrong
-                if (page_start_back - page_size > page_start_back + page_size)
+                if (mem[i] != 0 || mem2[i] != 0)
                 {
-                    assertm(false, "Back page commit failed!");
-                    return nullptr;
+                    printf("[Error]: Memory was not cleaned after Reset!\n");
+                    return false;
                 }
             }
-            page_start_back -= page_size;
+            memset(mem, 0xAA, size);
+            memset(mem2, 0x55, size);
+            allocator.Reset();
         }
-#endif // USING_VIRTUAL_MEMORY
-
-        // Allocate with negative alignment and correct offset address (provide prev address)
-        uintptr_t allocation_address = AllocateInternal(size, aligned_address, last_data_begin_address_back);
-
-        // Update internal address pointers
-        last_data_begin_address_back = allocation_address;
-        next_free_address_back = allocation_address - sizeof(Metadata);
-#if WITH_DEBUG_CANARIES
-        next_free_address_back -= sizeof(CANARY);
-#endif
 
-        return reinterpret_cast<void *>(allocation_address);
+        allocator.WaitForReclaim();
+        allocator.SetReclaimer(nullptr, mode);
+        return true;
     }
 
-    // LIFO is assumed.
-    // Frees the given memory by moving the internal front addresses
-    void Free(void *memory)
+    // Checks if the reclaimer leaves the pages decommitted by Trim() alone and still cleans the ones which stay
+    // committed, when one end had used almost all of the other end's pages
+    template <class A, class R> bool VerifyReclaimAfterTrim(A &allocator, R &reclaimer, typename R::Mode mode)
     {
-        // Is there anything to free?
-        if (last_data_begin_address_front == allocation_begin)
+        size_t size = allocator.GetReservedSize() - 200;
+        for (int round = 0; round < 2; round++)
         {
-            assertm(false, "Cannot free an empty front");
-            return;
+            // The large block reaches into the last page of the other end, which keeps a small block there
+            uint8_t *small = nullptr;
+            if (round == 0)
+            {
+                allocator.Free(allocator.Allocate(size, 8));
+                small = static_cast<uint8_t *>(allocator.AllocateBack(8, 8));
+            }
+            else
+            {
+                allocator.FreeBack(allocator.AllocateBack(size, 8));
+                small = static_cast<uint8_t *>(allocator.Allocate(8, 8));
+            }
+            if (small == nullptr)
+            {
+                printf("[Error]: Allocator returned nullptr!\n");
+                return false;
+            }
+            memset(small, 0xAA, 8);
+            allocator.Trim(0);
+
+            allocator.SetReclaimer(&reclaimer, mode);
+            allocator.Reset();
+            uint8_t *mem = static_cast<uint8_t *>(allocator.Allocate(size, 8));
+            if (mem == nullptr)
+            {
+                printf("[Error]: Allocator returned nullptr!\n");
+                return false;
+            }
+            for (size_t i = 0; i < size; i++)
+            {
+                if (mem[i] != 0)
+                {
+                    printf("[Error]: Memory was not cleaned after Trim and Reset!\n");
+                    return false;
+                }
+            }
+            allocator.Free(mem);
+            allocator.SetReclaimer(nullptr, mode);
         }
+        return true;
+    }
 
-        // Is the user calling LIFO as intended?
-        uintptr_t address = reinterpret_cast<uintptr_t>(memory);
-        if (address != last_data_begin_address_front)
+    // Checks if zeroed allocations are zero, whether their memory was used before by the same side, by the other side
+    // or never
+    template <class A> bool VerifyAllocateZeroed(A &allocator, size_t alignment)
+    {
+        size_t size = allocator.GetReservedSize() / 4;
+        for (int round = 0; round < 2; round++)
         {
-            assertm(false, "Free must be called LIFO!");
-            return;
-        }
+            // Dirties most of the allocator from the front, then from the back
+            if (round == 0)
+            {
+                void *dirty = allocator.Allocate(3 * size, alignment);
+                memset(dirty, 0xFF, 3 * size);
+                allocator.Free(dirty);
+            }
+            else
+            {
+                void *dirty = allocator.AllocateBack(3 * size, alignment);
+                memset(dirty, 0xFF, 3 * size);
+                allocator.FreeBack(dirty);
+            }
 
-        Metadata *metadata = ReadMetadata(last_data_begin_address_front);
+            uint8_t *mem = static_cast<uint8_t *>(allocator.AllocateZeroed(size, alignment));
+            uint8_t *mem2 = static_cast<uint8_t *>(allocator.AllocateBackZeroed(2 * size, alignment));
+            if (mem == nullptr || mem2 == nullptr)
+            {
+                printf("[Error]: Allocator returned nullptr!\n");
+                return false;
+            }
+            for (size_t i = 0; i < size; i++)
+            {
+                if (mem[i] != 0 || mem2[i] != 0 || mem2[size + i] != 0)
+                {
+                    printf("[Error]: Zeroed allocation is not zero!\n");
+                    return false;
+                }
+            }
+            memset(mem, 0xFF, size);
+            memset(mem2, 0xFF, 2 * size);
+            allocator.FreeBack(mem2);
+            allocator.Free(mem);
+        }
+        return true;
+    }
+
+    // Checks if files are read into front and back allocations, and if reading past the end of the file fails without
+    // leaving a block behind. `flags` can open the file for overlapped I/O.
+    template <class A> bool VerifyAllocateFromFile(A &allocator, DWORD flags, size_t alignment)
+    {
+        const size_t file_size = 100000;
+        char path[MAX_PATH];
+        char directory[MAX_PATH];
+        if (!GetTempPathA(MAX_PATH, directory) || !GetTempFileNameA(directory, "des", 0, path))
+        {
+            printf("[Error]: Could not create a temporary file!\n");
+            return false;
+        }
+        HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                  FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE | flags, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            printf("[Error]: Could not create a temporary file!\n");
+            return false;
+        }
+
+        static uint8_t content[file_size];
+        for (size_t i = 0; i < file_size; i++)
+        {
+            content[i] = uint8_t(i * 7);
+        }
+        // Overlapped handles need an offset to write at, and might finish the write asynchronously
+        OVERLAPPED at_start = {};
+        DWORD written = 0;
+        BOOL done = WriteFile(file, content, DWORD(file_size), &written, &at_start);
+        if (!done && GetLastError() == ERROR_IO_PENDING)
+        {
+            done = GetOverlappedResult(file, &at_start, &written, TRUE);
+        }
+        bool passed = done && written == file_size;
+
+        uint8_t *mem = static_cast<uint8_t *>(allocator.AllocateFromFile(file, 1000, 50000, alignment));
+        uint8_t *mem2 = static_cast<uint8_t *>(allocator.AllocateBackFromFile(file, 0, 4096, alignment));
+        if (!passed || mem == nullptr || mem2 == nullptr || memcmp(mem, content + 1000, 50000) != 0 ||
+            memcmp(mem2, content, 4096) != 0)
+        {
+            printf("[Error]: File content was not read correctly!\n");
+            passed = false;
+        }
+
+        // Only 1000 bytes are left after this offset
+        if (allocator.AllocateFromFile(file, file_size - 1000, 2000, alignment) != nullptr || !allocator.IsLast(mem))
+        {
+            printf("[Error]: Reading past the end of the file did not fail cleanly!\n");
+            passed = false;
+        }
+
+        if (mem2 != nullptr)
+        {
+            allocator.FreeBack(mem2);
+        }
+        if (mem != nullptr)
+        {
+            allocator.Free(mem);
+        }
+        CloseHandle(file);
+        return passed;
+    }
+
+    // Checks if child allocators carved from a parent's blocks (and from each other) work on both ends without
+    // committing anything, and if the parent can free the block right after the child is gone
+    template <class A> bool VerifyChildAllocators(A &parent, size_t alignment)
+    {
+        const size_t size = 64 * 1024;
+        void *block = parent.Allocate(size, alignment);
+        size_t committed = parent.GetCommittedSize();
+        bool passed = block != nullptr;
+        {
+            A child(block, size);
+            void *mem = child.Allocate(1000, alignment);
+            void *child_block = child.AllocateBack(size / 2, alignment);
+            passed = passed && mem != nullptr && child_block != nullptr && child.IsValid();
+
+            A grandchild(child_block, size / 2);
+            void *mem2 = grandchild.Allocate(100, alignment);
+            void *mem3 = grandchild.AllocateBack(100, alignment);
+            passed = passed && mem2 != nullptr && mem3 != nullptr && grandchild.GetCommittedSize() == size / 2;
+            if (passed)
+            {
+                memset(mem, 0xAA, 1000);
+                memset(mem2, 0xBB, 100);
+                memset(mem3, 0xCC, 100);
+                // The child has room for about half of its block left
+                passed = child.Allocate(size, alignment) == nullptr;
+            }
+            // The children are dropped with their allocations still alive
+        }
+
+        if (parent.GetCommittedSize() != committed || !parent.IsLast(block))
+        {
+            printf("[Error]: Child allocators changed their parent!\n");
+            passed = false;
+        }
+        if (block != nullptr)
+        {
+            parent.Free(block);
+        }
+        return passed;
+    }
+
+} // namespace Tests
+
+// If set to 1, Free() and FreeBack() should assert if the memory canaries are corrupted
+#define WITH_DEBUG_CANARIES 1
+
+// Using mainly: https://docs.microsoft.com/en-us/windows/win32/memory/reserving-and-committing-memory
+// Additional info used:
+// https://social.msdn.microsoft.com/Forums/vstudio/en-US/117512d6-c485-471e-b48b-30a610881129/how-to-use-virtualalloc?forum=vcgeneral
+// https://docs.microsoft.com/en-us/windows/win32/api/memoryapi/nf-memoryapi-virtualalloc
+// https://docs.microsoft.com/en-us/windows/win32/api/sysinfoapi/nf-sysinfoapi-getsysteminfo
+// https://docs.microsoft.com/en-us/windows/win32/memory/memory-protection-constants
+#define USING_VIRTUAL_MEMORY 1
+
+// If set to 1, allocators of at least one large page (usually 2 MiB) try to use large pages, which take a lot of pressure
+// off the TLB. Windows only hands out large pages reserved and committed at once, so the whole allocator is committed
+// when it is created. Needs the "Lock pages in memory" privilege, without it the allocator silently falls back to
+// regular pages. Only has an effect with USING_VIRTUAL_MEMORY.
+// https://docs.microsoft.com/en-us/windows/win32/memory/large-page-support
+#define USING_LARGE_PAGES 0
+
+// If set to 1, one thread may own the front (Allocate/Free) while another thread owns the back (AllocateBack/FreeBack).
+// The state of each end lives on its own cache line and the ends only exchange their published free addresses, so the
+// two owners never take a lock. Everything else (Reset, Trim, ...) still needs both owners to be idle.
+#define WITH_TWO_OWNERS 0
+
+// If set to 1, every allocation is tagged with its call site and the allocator keeps per call site statistics, which
+// can be printed with PrintAllocationProfile(). Requires C++20 (std::source_location).
+#define WITH_ALLOCATION_PROFILING 0
+
+// If set to 1, coroutine frames of StackTask and DetachedTask are allocated from a CoroutineFrameStack.
+// Requires C++20.
+#define WITH_COROUTINES 0
+
+#if WITH_DEBUG_CANARIES
+static const uint16_t CANARY = 0x0DD0;
+#endif
+
+#if WITH_TWO_OWNERS
+// Both owners store their claim before they load the other end's free address. Sequential consistency keeps the load
+// from being reordered before the store, so at least one of two owners racing for the same gap sees the other's claim.
+static const std::memory_order CLAIM_ORDER = std::memory_order_seq_cst;
+static const std::memory_order CHECK_ORDER = std::memory_order_seq_cst;
+// Keeps the state of one end from sharing a cache line with the other end's state
+#define OWNER_STATE_ALIGNMENT alignas(64)
+#ifdef _MSC_VER
+// Padding the allocator because of the alignment is the whole point
+#pragma warning(disable : 4324)
+#endif
+#else
+static const std::memory_order CLAIM_ORDER = std::memory_order_relaxed;
+static const std::memory_order CHECK_ORDER = std::memory_order_acquire;
+#define OWNER_STATE_ALIGNMENT
+#endif
+
+#if WITH_COROUTINES
+#ifndef __cpp_impl_coroutine
+#error "WITH_COROUTINES requires C++20 coroutines"
+#endif
+#include <coroutine>
+#endif
+
+#if WITH_ALLOCATION_PROFILING
+#if WITH_TWO_OWNERS
+#error "The allocation profile is shared by both ends, it can't be used with WITH_TWO_OWNERS"
+#endif
+#if !__has_include(<source_location>)
+#error "WITH_ALLOCATION_PROFILING requires C++20 std::source_location"
+#endif
+#include <source_location>
+// Added to the allocation functions, so the call site is captured without changing any call
+#define ALLOCATION_SITE_PARAMETER , std::source_location site = std::source_location::current()
+// Passes the captured call site on, when one allocation function calls another
+#define ALLOCATION_SITE_ARGUMENT , site
+#else
+#define ALLOCATION_SITE_PARAMETER
+#define ALLOCATION_SITE_ARGUMENT
+#endif
+
+// Placed in front of the data
+struct Metadata
+{
+    Metadata(size_t content_size, uintptr_t previous_address)
+        : content_size(content_size), previous_address(previous_address)
+    {
+    }
+#if WITH_ALLOCATION_PROFILING
+    // Placed before the other members so their offset to the content stays the same
+    // ID of the call site in the allocator's AllocationProfile
+    uint32_t site_id = 0;
+    // Bytes skipped in front of this allocation to align it
+    uint32_t alignment_waste = 0;
+#endif
+    // Size of the content
+    size_t content_size;
+    // Address of the previous data (allocated before this data)
+    uintptr_t previous_address;
+};
+
+/**
+ * Bounds how many bytes the allocators using it may commit. Reservations are free, committed pages are what counts
+ * against container memory limits.
+ * Crossing the soft limit (in either direction) invokes the pressure callback, so the application can shed load. Once
+ * the hard limit would be exceeded, allocations which need another page return a nullptr instead of committing it.
+ * Allocators use the global budget unless they are given their own one.
+ **/
+class CommitBudget
+{
+  public:
+    // Called on the thread whose commit or decommit crossed the soft limit
+    typedef void (*PressureCallback)(CommitBudget &budget, bool above_soft_limit, void *user_data);
+
+    CommitBudget(size_t hard_limit = SIZE_MAX, size_t soft_limit = SIZE_MAX)
+        : hard_limit(hard_limit), soft_limit(soft_limit)
+    {
+    }
+
+    // The global budget is derived from the memory limit of the job object the process runs in (which is how Windows
+    // containers limit memory). The soft limit defaults to 3/4 of it. Without a limit the budget is unlimited.
+    static CommitBudget &Global()
+    {
+        // Never destroyed, allocators with static storage duration might still release their pages into it
+        static CommitBudget *global = []() {
+            size_t limit = QueryJobMemoryLimit();
+            return new CommitBudget(limit, limit == SIZE_MAX ? SIZE_MAX : limit / 4 * 3);
+        }();
+        return *global;
+    }
+
+    // Limits and callback are meant to be set up before allocators start committing against this budget
+    void SetLimits(size_t new_hard_limit, size_t new_soft_limit)
+    {
+        hard_limit = new_hard_limit;
+        soft_limit = new_soft_limit;
+    }
+
+    void SetPressureCallback(PressureCallback callback, void *user_data)
+    {
+        pressure_callback = callback;
+        pressure_user_data = user_data;
+    }
+
+    // Accounts for `bytes` newly committed bytes.
+    // Returns false without changing anything if that would exceed the hard limit.
+    bool TryCharge(size_t bytes)
+    {
+        size_t previous = committed.load(std::memory_order_relaxed);
+        do
+        {
+            if (bytes > hard_limit || previous > hard_limit - bytes)
+            {
+                return false;
+            }
+        } while (!committed.compare_exchange_weak(previous, previous + bytes, std::memory_order_relaxed));
+
+        NotifyIfCrossed(previous, previous + bytes);
+        return true;
+    }
+
+    // Accounts for `bytes` newly committed bytes, even if that exceeds the hard limit
+    void Charge(size_t bytes)
+    {
+        size_t previous = committed.fetch_add(bytes, std::memory_order_relaxed);
+        NotifyIfCrossed(previous, previous + bytes);
+    }
+
+    // Accounts for `bytes` decommitted bytes
+    void Release(size_t bytes)
+    {
+        size_t previous = committed.fetch_sub(bytes, std::memory_order_relaxed);
+        NotifyIfCrossed(previous, previous - bytes);
+    }
+
+    size_t GetCommitted()
+    {
+        return committed.load(std::memory_order_relaxed);
+    }
+
+    size_t GetHardLimit()
+    {
+        return hard_limit;
+    }
+
+    size_t GetSoftLimit()
+    {
+        return soft_limit;
+    }
+
+  private:
+    std::atomic<size_t> committed{0};
+    size_t hard_limit;
+    size_t soft_limit;
+    PressureCallback pressure_callback = nullptr;
+    void *pressure_user_data = nullptr;
+
+    void NotifyIfCrossed(size_t previous, size_t current)
+    {
+        bool was_above = previous > soft_limit;
+        bool is_above = current > soft_limit;
+        if (was_above != is_above && pressure_callback != nullptr)
+        {
+            pressure_callback(*this, is_above, pressure_user_data);
+        }
+    }
+
+    // Returns the job or process memory limit of the job object the process is assigned to, SIZE_MAX if there is none
+    static size_t QueryJobMemoryLimit()
+    {
+        size_t limit = SIZE_MAX;
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION info = {};
+        // A NULL handle queries the job of the calling process
+        if (QueryInformationJobObject(NULL, JobObjectExtendedLimitInformation, &info, sizeof(info), NULL))
+        {
+            if (info.BasicLimitInformation.LimitFlags & JOB_OBJECT_LIMIT_JOB_MEMORY)
+            {
+                limit = info.JobMemoryLimit;
+            }
+            if (info.BasicLimitInformation.LimitFlags & JOB_OBJECT_LIMIT_PROCESS_MEMORY)
+            {
+                limit = min(limit, info.ProcessMemoryLimit);
+            }
+        }
+        return limit;
+    }
+};
+
+#if WITH_ALLOCATION_PROFILING
+/**
+ * Per call site statistics of one allocator, separately for the front and the back.
+ * Call sites are identified by their std::source_location. Once MAX_SITES different sites were seen, further sites are
+ * summed up in the last entry.
+ **/
+class AllocationProfile
+{
+  public:
+    static const uint32_t MAX_SITES = 64;
+
+    enum End
+    {
+        FRONT = 0,
+        BACK = 1
+    };
+
+    struct SiteStats
+    {
+        size_t live_bytes = 0;
+        size_t peak_live_bytes = 0;
+        size_t live_count = 0;
+        size_t allocation_count = 0;
+        size_t alignment_waste = 0;
+        size_t failure_count = 0;
+    };
+
+    // Returns the ID of the given call site, registering it on first use
+    uint32_t GetSiteId(const std::source_location &site)
+    {
+        for (uint32_t id = 0; id < site_count; id++)
+        {
+            // file_name() points to a string literal. Identical literals usually share their address, but don't have
+            // to (e.g. MSVC without /GF), so the names are compared if the pointers differ
+            if (sites[id].line == site.line() && sites[id].column == site.column() &&
+                (sites[id].file == site.file_name() || strcmp(sites[id].file, site.file_name()) == 0))
+            {
+                return id;
+            }
+        }
+
+        if (site_count == MAX_SITES)
+        {
+            return MAX_SITES - 1;
+        }
+
+        Site &new_site = sites[site_count];
+        new_site.file = site.file_name();
+        new_site.function = site.function_name();
+        new_site.line = site.line();
+        new_site.column = site.column();
+        return site_count++;
+    }
+
+    void RecordAllocation(uint32_t site_id, End end, size_t size, size_t alignment_waste)
+    {
+        SiteStats &stats = sites[site_id].stats[end];
+        stats.live_bytes += size;
+        stats.peak_live_bytes = max(stats.peak_live_bytes, stats.live_bytes);
+        stats.live_count++;
+        stats.allocation_count++;
+        stats.alignment_waste += alignment_waste;
+    }
+
+    void RecordFree(uint32_t site_id, End end, size_t size)
+    {
+        SiteStats &stats = sites[site_id].stats[end];
+        stats.live_bytes -= size;
+        stats.live_count--;
+    }
+
+    void RecordFailure(uint32_t site_id, End end)
+    {
+        sites[site_id].stats[end].failure_count++;
+    }
+
+    // Everything was freed at once, peaks and totals are kept
+    void RecordReset()
+    {
+        for (uint32_t id = 0; id < site_count; id++)
+        {
+            for (SiteStats &stats : sites[id].stats)
+            {
+                stats.live_bytes = 0;
+                stats.live_count = 0;
+            }
+        }
+    }
+
+    const SiteStats &GetStats(uint32_t site_id, End end) const
+    {
+        return sites[site_id].stats[end];
+    }
+
+    uint32_t GetSiteCount() const
+    {
+        return site_count;
+    }
+
+    void Print(FILE *out) const
+    {
+        fprintf(out, "%-6s %12s %12s %8s %8s %12s %8s  %s\n", "end", "live bytes", "peak bytes", "live", "total",
+                "align waste", "failed", "site");
+        for (uint32_t id = 0; id < site_count; id++)
+        {
+            const Site &site = sites[id];
+            for (int end = FRONT; end <= BACK; end++)
+            {
+                const SiteStats &stats = site.stats[end];
+                if (stats.allocation_count == 0 && stats.failure_count == 0)
+                {
+                    continue;
+                }
+                fprintf(out, "%-6s %12zu %12zu %8zu %8zu %12zu %8zu  %s:%u (%s)%s\n", end == FRONT ? "front" : "back",
+                        stats.live_bytes, stats.peak_live_bytes, stats.live_count, stats.allocation_count,
+                        stats.alignment_waste, stats.failure_count, site.file, unsigned(site.line), site.function,
+                        id == MAX_SITES - 1 ? " and later sites" : "");
+            }
+        }
+    }
+
+  private:
+    struct Site
+    {
+        const char *file = nullptr;
+        const char *function = nullptr;
+        uint_least32_t line = 0;
+        uint_least32_t column = 0;
+        SiteStats stats[2];
+    };
+
+    Site sites[MAX_SITES];
+    uint32_t site_count = 0;
+};
+#endif
+
+/**
+ * Serves allocations which don't fit into the allocator any more, instead of failing them.
+ * `back` tells whether the allocation was made with AllocateBack(), so e.g. a second allocator can serve each end
+ * from its own end. The fallback must not hand out memory inside the allocator's own range.
+ **/
+struct OverflowFallback
+{
+    typedef void *(*AllocateFunction)(size_t size, size_t alignment, bool back, void *user_data);
+    typedef void (*FreeFunction)(void *memory, bool back, void *user_data);
+
+    AllocateFunction allocate_function = nullptr;
+    FreeFunction free_function = nullptr;
+    void *user_data = nullptr;
+
+    // Serves overflowing allocations from the heap
+    static OverflowFallback Malloc()
+    {
+        OverflowFallback fallback;
+        fallback.allocate_function = [](size_t size, size_t alignment, bool, void *) {
+            return _aligned_malloc(size, alignment);
+        };
+        fallback.free_function = [](void *memory, bool, void *) { _aligned_free(memory); };
+        return fallback;
+    }
+
+    // Serves overflowing allocations from another (usually larger) allocator, the front from its front and the back
+    // from its back. Defined after DoubleEndedStackAllocator.
+    static OverflowFallback Arena(class DoubleEndedStackAllocator &arena);
+
+    static OverflowFallback Callback(AllocateFunction allocate_function, FreeFunction free_function, void *user_data)
+    {
+        OverflowFallback fallback;
+        fallback.allocate_function = allocate_function;
+        fallback.free_function = free_function;
+        fallback.user_data = user_data;
+        return fallback;
+    }
+};
+
+// How often and how much an end of the allocator had to use its fallback
+struct FallbackStats
+{
+    size_t allocation_count = 0;
+    // Sum of all sizes requested from the fallback
+    size_t total_bytes = 0;
+    size_t live_bytes = 0;
+    size_t peak_live_bytes = 0;
+    size_t largest_allocation = 0;
+};
+
+// Ranges at least this large are cleared with non-temporal stores. Smaller ones are likely to be used right away and
+// should stay in the cache.
+static const size_t NON_TEMPORAL_CLEAR_THRESHOLD = 256 * 1024;
+
+// Sets `size` bytes at `memory` to zero
+static void ClearMemory(void *memory, size_t size)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+    if (size >= NON_TEMPORAL_CLEAR_THRESHOLD)
+    {
+        uint8_t *begin = static_cast<uint8_t *>(memory);
+        uint8_t *end = begin + size;
+        // Streaming stores need 16 byte aligned addresses, the unaligned edges are cleared with memset
+        uint8_t *aligned_begin = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(begin) + 15) & ~uintptr_t(15));
+        uint8_t *aligned_end = aligned_begin + (size_t(end - aligned_begin) & ~size_t(63));
+        memset(begin, 0, aligned_begin - begin);
+
+        __m128i zero = _mm_setzero_si128();
+        // A full cache line per iteration, so the write combining buffers are flushed as whole lines
+        for (uint8_t *line = aligned_begin; line < aligned_end; line += 64)
+        {
+            _mm_stream_si128(reinterpret_cast<__m128i *>(line), zero);
+            _mm_stream_si128(reinterpret_cast<__m128i *>(line + 16), zero);
+            _mm_stream_si128(reinterpret_cast<__m128i *>(line + 32), zero);
+            _mm_stream_si128(reinterpret_cast<__m128i *>(line + 48), zero);
+        }
+        // Non-temporal stores are weakly ordered, this orders them before anything the caller stores afterwards
+        _mm_sfence();
+
+        memset(aligned_end, 0, end - aligned_end);
+        return;
+    }
+#endif
+    memset(memory, 0, size);
+}
+
+// Reclaimers move their watermarks in chunks of this size, so owners waiting for a small part don't wait for the whole
+// range
+static const size_t RECLAIM_CHUNK_SIZE = 256 * 1024;
+
+// Dirty ranges an allocator handed to a BackgroundReclaimer on Reset(). The front range is cleaned from its begin
+// upwards and the back range from its end downwards, so the owners can reuse the cleaned parts while the rest is still
+// being worked on.
+// Pages decommitted by the reclaimer which couldn't be committed again, published before the watermark passes them
+struct UncommittedRange
+{
+    std::atomic<uintptr_t> begin{0};
+    std::atomic<uintptr_t> end{0};
+
+    void Set(uintptr_t new_begin, uintptr_t new_end)
+    {
+        begin.store(new_begin, std::memory_order_relaxed);
+        end.store(new_end, std::memory_order_release);
+    }
+
+    void Clear()
+    {
+        end.store(0, std::memory_order_relaxed);
+        begin.store(0, std::memory_order_relaxed);
+    }
+
+    bool IsEmpty()
+    {
+        return end.load(std::memory_order_acquire) == 0;
+    }
+
+    // Committing pages again which are already committed keeps their content, so both owners may call this
+    bool Commit()
+    {
+        uintptr_t range_end = end.load(std::memory_order_acquire);
+        uintptr_t range_begin = begin.load(std::memory_order_relaxed);
+        return range_end == 0 ||
+               VirtualAlloc(reinterpret_cast<void *>(range_begin), range_end - range_begin, MEM_COMMIT, PAGE_READWRITE);
+    }
+};
+
+struct ReclaimJob
+{
+    uintptr_t front_begin = 0;
+    uintptr_t front_end = 0;
+    uintptr_t back_begin = 0;
+    uintptr_t back_end = 0;
+    // Everything below is clean again
+    std::atomic<uintptr_t> front_watermark{0};
+    // Everything from here on is clean again
+    std::atomic<uintptr_t> back_watermark{0};
+    // 0 if the pages can't be decommitted (no virtual memory or large pages)
+    size_t page_size = 0;
+    bool decommit = false;
+    // Pages of either side which are still charged but no longer committed (e.g. the system's commit limit was reached
+    // in between). The owners commit them before they use memory handed over to the reclaimer. A side with such pages
+    // isn't decommitted again until they are committed, so there is at most one range per side.
+    UncommittedRange front_uncommitted;
+    UncommittedRange back_uncommitted;
+    // Queue of the reclaimer
+    ReclaimJob *next = nullptr;
+
+    bool IsFrontDone()
+    {
+        return front_watermark.load(std::memory_order_acquire) >= front_end;
+    }
+
+    bool IsBackDone()
+    {
+        return back_watermark.load(std::memory_order_acquire) <= back_begin;
+    }
+
+    bool CommitUncommitted()
+    {
+        return front_uncommitted.Commit() && back_uncommitted.Commit();
+    }
+};
+
+/**
+ * Background thread which cleans the memory of allocators after Reset(), so the owner doesn't stall on zeroing large
+ * arenas holding sensitive data. It either zeroes the memory, or decommits the pages and commits them again, which gives
+ * the physical memory back and leaves demand-zero pages behind.
+ * One reclaimer can serve any number of allocators. It has to outlive them.
+ **/
+class BackgroundReclaimer
+{
+  public:
+    enum Mode
+    {
+        ZERO,
+        DECOMMIT
+    };
+
+    BackgroundReclaimer() : thread([this]() { Run(); })
+    {
+    }
+
+    // Finishes all queued jobs first
+    ~BackgroundReclaimer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    BackgroundReclaimer(const BackgroundReclaimer &other) = delete;
+    BackgroundReclaimer &operator=(const BackgroundReclaimer &other) = delete;
+
+    // The job must not be changed until it is done
+    void Submit(ReclaimJob &job)
+    {
+        job.next = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (last != nullptr)
+            {
+                last->next = &job;
+            }
+            else
+            {
+                first = &job;
+            }
+            last = &job;
+        }
+        wake.notify_one();
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    ReclaimJob *first = nullptr;
+    ReclaimJob *last = nullptr;
+    bool stopping = false;
+    // Started last, after everything it uses is initialized
+    std::thread thread;
+
+    void Run()
+    {
+        while (true)
+        {
+            ReclaimJob *job = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return first != nullptr || stopping; });
+                if (first == nullptr)
+                {
+                    return;
+                }
+                job = first;
+                first = job->next;
+                if (first == nullptr)
+                {
+                    last = nullptr;
+                }
+            }
+            Process(*job);
+        }
+    }
+
+    // The job may be destroyed as soon as both watermarks are published, so it isn't touched afterwards
+    void Process(ReclaimJob &job)
+    {
+        uintptr_t front = job.front_begin;
+        uintptr_t back = job.back_end;
+        uintptr_t front_end = job.front_end;
+        uintptr_t back_begin = job.back_begin;
+        size_t page_size = job.page_size;
+        bool decommit = job.decommit && page_size != 0;
+        bool decommit_front = decommit && job.front_uncommitted.IsEmpty();
+        bool decommit_back = decommit && job.back_uncommitted.IsEmpty();
+        // Alternating between both sides, so neither owner waits for the other side to be done
+        while (front < front_end || back > back_begin)
+        {
+            if (front < front_end)
+            {
+                uintptr_t chunk_end = front + min(RECLAIM_CHUNK_SIZE, front_end - front);
+                // Once pages couldn't be committed again, the rest of the side is only zeroed
+                if (!Clean(front, chunk_end, page_size, decommit_front, job.front_uncommitted))
+                {
+                    decommit_front = false;
+                }
+                front = chunk_end;
+                job.front_watermark.store(front, std::memory_order_release);
+            }
+            if (back > back_begin)
+            {
+                uintptr_t chunk_begin = back - min(RECLAIM_CHUNK_SIZE, back - back_begin);
+                if (!Clean(chunk_begin, back, page_size, decommit_back, job.back_uncommitted))
+                {
+                    decommit_back = false;
+                }
+                back = chunk_begin;
+                job.back_watermark.store(back, std::memory_order_release);
+            }
+        }
+    }
+
+    // Returns false if decommitted pages couldn't be committed again, they are left to the owners in `uncommitted`
+    static bool Clean(uintptr_t begin, uintptr_t end, size_t page_size, bool decommit, UncommittedRange &uncommitted)
+    {
+        bool recommitted = true;
+        uintptr_t pages_begin = begin;
+        uintptr_t pages_end = begin;
+        if (decommit)
+        {
+            // Only whole pages can be decommitted, the partial pages at the edges are zeroed
+            pages_begin = (begin + page_size - 1) & ~(uintptr_t(page_size) - 1);
+            pages_end = max(end & ~(uintptr_t(page_size) - 1), pages_begin);
+        }
+        if (pages_begin < pages_end)
+        {
+            void *pages = reinterpret_cast<void *>(pages_begin);
+            VirtualFree(pages, pages_end - pages_begin, MEM_DECOMMIT);
+            // The allocator still counts the pages as committed, they just don't hold physical memory until touched
+            recommitted = VirtualAlloc(pages, pages_end - pages_begin, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+            if (!recommitted)
+            {
+                uncommitted.Set(pages_begin, pages_end);
+            }
+        }
+        else
+        {
+            pages_begin = end;
+            pages_end = end;
+        }
+        ClearMemory(reinterpret_cast<void *>(begin), pages_begin - begin);
+        ClearMemory(reinterpret_cast<void *>(pages_end), end - pages_end);
+        return recommitted;
+    }
+};
+
+/**
+ * You work on your DoubleEndedStackAllocator. Stick to the provided interface, this is
+ * necessary for testing your assignment in the end. Don't remove or rename the public
+ * interface of the allocator. Also don't add any additional initialization code, the
+ * allocator needs to work after it was created and its constructor was called. You can
+ * add additional public functions but those should only be used for your own testing.
+ **/
+
+class DoubleEndedStackAllocator
+{
+  public:
+    DoubleEndedStackAllocator(size_t max_size)
+    {
+#if USING_VIRTUAL_MEMORY
+        // Look up page size
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        page_size = system_info.dwPageSize;
+
+        void *begin = nullptr;
+#if USING_LARGE_PAGES
+        begin = AllocateLargePages(max_size);
+#endif
+        if (begin == nullptr)
+        {
+            // If given size is smaller than a page, use page size instead
+            max_size = max(max_size, page_size);
+            // The reservation covers whole pages anyway, rounding up keeps the committed ranges of both sides page
+            // aligned
+            max_size = (max_size + page_size - 1) & ~(size_t(page_size) - 1);
+            // Reserve the max size and set its memory protection constants to no access so errors are noticable
+            begin = VirtualAlloc(NULL, max_size, MEM_RESERVE, PAGE_NOACCESS);
+            assertm(begin != nullptr, "Memory reservation failed!");
+        }
+#else
+        // Without virtual memory the whole size is committed right away
+        void *begin = nullptr;
+        if (budget->TryCharge(max_size))
+        {
+            begin = malloc(max_size);
+            assertm(begin != nullptr, "Malloc failed!");
+            if (begin == nullptr)
+            {
+                budget->Release(max_size);
+            }
+        }
+#endif
+        Initialize(begin, max_size);
+    }
+
+    // Creates a child allocator over `memory`, usually a block allocated from another allocator, e.g. for a scope
+    // nested in the parent's one. Nothing is reserved or committed, the child uses the pages of the block as they are.
+    // Destroying the child doesn't touch the memory, so the parent can free the block right after, no matter what the
+    // child still holds. The block has to outlive the child.
+    DoubleEndedStackAllocator(void *memory, size_t size) : owns_memory(false)
+    {
+#if USING_VIRTUAL_MEMORY
+        // Only needed for Reset() with a reclaimer, reading it doesn't enter the kernel
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        page_size = system_info.dwPageSize;
+#endif
+        Initialize(memory, size);
+    }
+
+    ~DoubleEndedStackAllocator(void)
+    {
+        FreeFallbackBlocks();
+        // The reclaimer must be done with the pages before they are released
+        WaitForReclaim();
+        if (!owns_memory)
+        {
+            return;
+        }
+        if (is_valid)
+        {
+            budget->Release(GetChargedSize());
+        }
+#if USING_VIRTUAL_MEMORY
+        VirtualFree(reinterpret_cast<void *>(allocation_begin), 0, MEM_RELEASE);
+#else
+        free(reinterpret_cast<void *>(allocation_begin));
+#endif
+    }
+
+    // Copy and Move Constructors / Assignment Operators are explicitly deleted.
+    // There are some ways to get them to work, but they all require the user to be very cautious and might be
+    // unexpected (especially when called implicitly), so we think it's best to keep the user from invoking them
+    // entirely.
+    DoubleEndedStackAllocator(const DoubleEndedStackAllocator &other) = delete;             // Copy Constructor
+    DoubleEndedStackAllocator(DoubleEndedStackAllocator &&other) = delete;                  // Move Constructor
+    DoubleEndedStackAllocator &operator=(const DoubleEndedStackAllocator &other) = delete;  // Copy Assignment Operator
+    DoubleEndedStackAllocator &operator=(const DoubleEndedStackAllocator &&other) = delete; // Move Assignment Operator
+
+    // Returns `false` if the Allocator is in an unusable state, e.g. because the initial memory allocation failed.
+    bool IsValid()
+    {
+        return is_valid;
+    }
+
+    /**
+     * Memory layout of content is:
+     * ...[previous Content][previous Canary][   ][Canary][Metadata][Content][Canary][   ][next
+     *Canary][nextMetadata].... Pointer points to border of Metadata and Content. [Content] Block will be on aligned
+     *adress. This means there might be unused space (note the [   ] blocks above) before Metadata.
+     **/
+
+    // Alignment must be a power of two.
+    // Returns a nullptr if there is not enough memory left.
+    void *Allocate(size_t size, size_t alignment ALLOCATION_SITE_PARAMETER)
+    {
+        return AllocateFromFront(size, alignment, false ALLOCATION_SITE_ARGUMENT);
+    }
+
+    // Like Allocate(), but running out of space is expected by the caller and doesn't trigger an assertion
+    void *TryAllocate(size_t size, size_t alignment ALLOCATION_SITE_PARAMETER)
+    {
+        return AllocateFromFront(size, alignment, true ALLOCATION_SITE_ARGUMENT);
+    }
+
+    // Alignment must be a power of two.
+    // Returns a nullptr if there is not enough memory left.
+    void *AllocateBack(size_t size, size_t alignment ALLOCATION_SITE_PARAMETER)
+    {
+        return AllocateFromBack(size, alignment, false ALLOCATION_SITE_ARGUMENT);
+    }
+
+    // Like AllocateBack(), but running out of space is expected by the caller and doesn't trigger an assertion
+    void *TryAllocateBack(size_t size, size_t alignment ALLOCATION_SITE_PARAMETER)
+    {
+        return AllocateFromBack(size, alignment, true ALLOCATION_SITE_ARGUMENT);
+    }
+
+    // Like Allocate(), but the content is zeroed. Only the part of it which was used before is cleared, pages committed
+    // for this allocation already come zeroed from the OS.
+    void *AllocateZeroed(size_t size, size_t alignment ALLOCATION_SITE_PARAMETER)
+    {
+        // Read before the allocation moves it
+        uintptr_t dirty_end = dirty_end_front.load(std::memory_order_relaxed);
+        void *memory = Allocate(size, alignment ALLOCATION_SITE_ARGUMENT);
+        if (memory != nullptr)
+        {
+            ClearDirty(reinterpret_cast<uintptr_t>(memory), size, dirty_end,
+                       dirty_begin_back.load(std::memory_order_relaxed));
+        }
+        return memory;
+    }
+
+    // Like AllocateBack(), but the content is zeroed. Only the part of it which was used before is cleared, pages
+    // committed for this allocation already come zeroed from the OS.
+    void *AllocateBackZeroed(size_t size, size_t alignment ALLOCATION_SITE_PARAMETER)
+    {
+        // Read before the allocation moves it
+        uintptr_t dirty_begin = dirty_begin_back.load(std::memory_order_relaxed);
+        void *memory = AllocateBack(size, alignment ALLOCATION_SITE_ARGUMENT);
+        if (memory != nullptr)
+        {
+            ClearDirty(reinterpret_cast<uintptr_t>(memory), size, dirty_end_front.load(std::memory_order_relaxed),
+                       dirty_begin);
+        }
+        return memory;
+    }
+
+    // Allocates `size` bytes like Allocate() and reads them from `file`, starting at `offset`, right into the
+    // allocation. The block is freed with Free() like any other.
+    // `file` may be synchronous or overlapped, see ReadFileAt() for how its file pointer and pending reads are handled.
+    // Returns a nullptr if there is not enough memory left, or the file couldn't be read completely.
+    void *AllocateFromFile(HANDLE file, uint64_t offset, size_t size, size_t alignment ALLOCATION_SITE_PARAMETER)
+    {
+        void *memory = Allocate(size, alignment ALLOCATION_SITE_ARGUMENT);
+        if (memory != nullptr && !ReadFileAt(file, offset, memory, size))
+        {
+            Free(memory);
+            return nullptr;
+        }
+        return memory;
+    }
+
+    // Allocates `size` bytes like AllocateBack() and reads them from `file`, starting at `offset`, right into the
+    // allocation. The block is freed with FreeBack() like any other.
+    // `file` may be synchronous or overlapped, see ReadFileAt() for how its file pointer and pending reads are handled.
+    // Returns a nullptr if there is not enough memory left, or the file couldn't be read completely.
+    void *AllocateBackFromFile(HANDLE file, uint64_t offset, size_t size, size_t alignment ALLOCATION_SITE_PARAMETER)
+    {
+        void *memory = AllocateBack(size, alignment ALLOCATION_SITE_ARGUMENT);
+        if (memory != nullptr && !ReadFileAt(file, offset, memory, size))
+        {
+            FreeBack(memory);
+            return nullptr;
+        }
+        return memory;
+    }
+
+    // LIFO is assumed. Blocks served by the fallback aren't part of the stack, freeing them doesn't touch its order.
+    // Frees the given memory by moving the internal front addresses
+    void Free(void *memory)
+    {
+        if (memory == nullptr)
+        {
+            assertm(false, "Cannot free nullptr");
+            return;
+        }
+
+        uintptr_t address = reinterpret_cast<uintptr_t>(memory);
+        FallbackHeader *fallback_block = FindFallbackBlock(address, fallback_blocks_front);
+        if (fallback_block != nullptr)
+        {
+            FreeFallback(fallback_block, false, fallback_stats_front);
+            return;
+        }
+
+        // Is there anything to free?
+        if (last_data_begin_address_front == allocation_begin)
+        {
+            assertm(false, "Cannot free an empty front");
+            return;
+        }
+
+        // Is the user calling LIFO as intended?
+        if (address != last_data_begin_address_front)
+        {
+            assertm(false, "Free must be called LIFO!");
+            return;
+        }
+
+        Metadata *metadata = ReadMetadata(last_data_begin_address_front);
+        uintptr_t previous_address = metadata->previous_address;
+
+#if WITH_DEBUG_CANARIES
+        // Check canary before
+        if (!IsCanaryValid(last_data_begin_address_front - sizeof(Metadata) - sizeof(CANARY)))
+        {
+            assertm(false, "First Canary was overwritten - the memory is corrupted!");
+            is_valid = false;
+            return;
+        }
+
+        // Check if content size was overwritten
+        if (last_data_begin_address_front + metadata->content_size > allocation_end)
+        {
+            assertm(false, "Metadata was overwritten - the memory is corrupted!");
+            is_valid = false;
+            return;
+        }
+
+        // Check canary after
+        if (!IsCanaryValid(last_data_begin_address_front + metadata->content_size))
+        {
+            assertm(false, "Second Canary was overwritten - the memory is corrupted!");
+            is_valid = false;
+            return;
+        }
+
+        // Check validity of previous address with canaries
+        // Check if address is outside allocator range
+        if (previous_address > allocation_end || previous_address < allocation_begin)
+        {
+            assertm(false, "Metadata was overwritten - the memory is corrupted!");
+            is_valid = false;
+            return;
+        }
+
+        // The first allocation of the front has no previous allocation
+        if (previous_address != allocation_begin)
+        {
+            Metadata *previous_metadata = ReadMetadata(previous_address);
+
+            // Canary before prev address
+            if (previous_address - sizeof(Metadata) - sizeof(CANARY) < allocation_begin ||
+                !IsCanaryValid(previous_address - sizeof(Metadata) - sizeof(CANARY)))
+            {
+                assertm(false, "Metadata was overwritten - the memory is corrupted!");
+                is_valid = false;
+                return;
+            }
+
+            // Canary after prev address
+            if (previous_address + previous_metadata->content_size > allocation_end ||
+                !IsCanaryValid(previous_address + previous_metadata->content_size))
+            {
+                assertm(false, "Metadata was overwritten - the memory is corrupted!");
+                is_valid = false;
+                return;
+            }
+        }
+#endif
+
+#if WITH_ALLOCATION_PROFILING
+        profile.RecordFree(metadata->site_id, AllocationProfile::FRONT, metadata->content_size);
+#endif
+
+        // If beginning reached, set free address to beginning
+        // Release makes all accesses to the freed memory happen before the back can claim it
+        if (previous_address == allocation_begin)
+        {
+            last_data_begin_address_front = allocation_begin;
+            next_free_address_front.store(allocation_begin, std::memory_order_release);
+            return;
+        }
+
+        // Set current to previous address
+        last_data_begin_address_front = metadata->previous_address;
+
+        // Add data size from new front
+        uintptr_t free_address_front = last_data_begin_address_front + ReadMetadata(previous_address)->content_size;
+
+#if WITH_DEBUG_CANARIES
+        // Add Canary
+        free_address_front += sizeof(CANARY);
+#endif
+        next_free_address_front.store(free_address_front, std::memory_order_release);
+    }
+
+    // LIFO is assumed. Blocks served by the fallback aren't part of the stack, freeing them doesn't touch its order.
+    // Frees the given memory by moving the internal back addresses
+    void FreeBack(void *memory)
+    {
+        if (memory == nullptr)
+        {
+            assertm(false, "Cannot free nullptr");
+            return;
+        }
+
+        uintptr_t address = reinterpret_cast<uintptr_t>(memory);
+        FallbackHeader *fallback_block = FindFallbackBlock(address, fallback_blocks_back);
+        if (fallback_block != nullptr)
+        {
+            FreeFallback(fallback_block, true, fallback_stats_back);
+            return;
+        }
+
+        // Is there anything to free?
+        if (last_data_begin_address_back == allocation_end)
+        {
+            assertm(false, "Cannot free an empty back");
+            return;
+        }
+
+        // Is the user calling LIFO as intended?
+        if (address != last_data_begin_address_back)
+        {
+            assertm(false, "FreeBack must be called LIFO!");
+            return;
+        }
+
+        Metadata *metadata = ReadMetadata(last_data_begin_address_back);
         uintptr_t previous_address = metadata->previous_address;
-        // Read data from new front
-        Metadata *previous_metadata = ReadMetadata(previous_address);
 
-#if WITH_DEBUG_CANARIES
-        // Check canary before
-        if (!IsCanaryValid(last_data_begin_address_front - sizeof(Metadata) - sizeof(CANARY)))
+#if WITH_DEBUG_CANARIES
+        // Check canary before
+        if (!IsCanaryValid(last_data_begin_address_back - sizeof(Metadata) - sizeof(CANARY)))
+        {
+            assertm(false, "First Canary was overwritten - the memory is corrupted!");
+            is_valid = false;
+            return;
+        }
+
+        // Check if content size was overwritten
+        if (last_data_begin_address_back + metadata->content_size > allocation_end)
+        {
+            assertm(false, "Metadata was overwritten - the memory is corrupted!");
+            is_valid = false;
+            return;
+        }
+
+        // Check canary after
+        if (!IsCanaryValid(last_data_begin_address_back + metadata->content_size))
+        {
+            assertm(false, "Second Canary was overwritten - the memory is corrupted!");
+            is_valid = false;
+            return;
+        }
+
+        // Check validity of previous address with canaries
+        // Check if address is outside allocator range
+        if (previous_address > allocation_end || previous_address < allocation_begin)
+        {
+            assertm(false, "Metadata was overwritten - the memory is corrupted!");
+            is_valid = false;
+            return;
+        }
+
+        // The first allocation of the back has no previous allocation
+        if (previous_address != allocation_end)
+        {
+            Metadata *previous_metadata = ReadMetadata(previous_address);
+
+            // Canary before prev address
+            if (previous_address - sizeof(Metadata) - sizeof(CANARY) < allocation_begin ||
+                !IsCanaryValid(previous_address - sizeof(Metadata) - sizeof(CANARY)))
+            {
+                assertm(false, "Metadata was overwritten - the memory is corrupted!");
+                is_valid = false;
+                return;
+            }
+
+            // Canary after prev address
+            if (previous_address + previous_metadata->content_size > allocation_end ||
+                !IsCanaryValid(previous_address + previous_metadata->content_size))
+            {
+                assertm(false, "Metadata was overwritten - the memory is corrupted!");
+                is_valid = false;
+                return;
+            }
+        }
+
+#endif
+
+#if WITH_ALLOCATION_PROFILING
+        profile.RecordFree(metadata->site_id, AllocationProfile::BACK, metadata->content_size);
+#endif
+
+        // If end reached, set free address to end
+        // Release makes all accesses to the freed memory happen before the front can claim it
+        if (previous_address == allocation_end)
+        {
+            last_data_begin_address_back = allocation_end;
+            next_free_address_back.store(allocation_end, std::memory_order_release);
+            return;
+        }
+
+        // Set current to previous address
+        last_data_begin_address_back = previous_address;
+
+        // Add data size from new back
+        uintptr_t free_address_back = last_data_begin_address_back - sizeof(Metadata);
+#if WITH_DEBUG_CANARIES
+        free_address_back -= sizeof(CANARY);
+#endif
+        next_free_address_back.store(free_address_back, std::memory_order_release);
+    }
+
+    // Returns true if `memory` is the allocation Free() expects next
+    bool IsLast(void *memory)
+    {
+        return reinterpret_cast<uintptr_t>(memory) == last_data_begin_address_front;
+    }
+
+    // Returns true if `memory` is the allocation FreeBack() expects next
+    bool IsLastBack(void *memory)
+    {
+        return reinterpret_cast<uintptr_t>(memory) == last_data_begin_address_back;
+    }
+
+    // Clear the internal state so that the whole allocator range is available again. Live blocks served by the
+    // fallback are given back to it. With two owners, both have to be idle.
+    // Committed pages stay committed, so refilling the allocator does not commit them again. Use Trim() to give them
+    // back to the OS.
+    // With a reclaimer, all memory used since the last Reset() is cleaned in the background. Allocations reaching into
+    // memory which isn't clean yet wait for the reclaimer.
+    void Reset(void)
+    {
+        FreeFallbackBlocks();
+        if (reclaimer != nullptr)
+        {
+            HandOverToReclaimer();
+        }
+
+        // Reset the pointers to the outer edges of the allocation
+        last_data_begin_address_front = allocation_begin;
+        last_data_begin_address_back = allocation_end;
+
+        next_free_address_front.store(allocation_begin, std::memory_order_relaxed);
+        next_free_address_back.store(allocation_end, std::memory_order_relaxed);
+
+#if WITH_ALLOCATION_PROFILING
+        profile.RecordReset();
+#endif
+    }
+
+    // Decommits pages which are not used by either side until at most `committed_target` bytes stay committed.
+    // Pages are taken from the inner edge of the front first, then from the inner edge of the back.
+    // The reservation is kept, so growing again later only costs a commit. With two owners, both have to be idle.
+    void Trim(size_t committed_target)
+    {
+#if USING_VIRTUAL_MEMORY
+        // Pages the reclaimer couldn't commit again have to stay within the committed ones
+        if (!WaitForReclaim())
+        {
+            return;
+        }
+        size_t committed = GetCommittedSize();
+        // Large pages can't be decommitted one by one, and the pages of a child belong to its parent
+        if (committed <= committed_target || large_pages || !owns_memory)
+        {
+            return;
+        }
+
+        // Pages touched by live allocations have to stay committed
+        uintptr_t page_mask = ~(uintptr_t(page_size) - 1);
+        uintptr_t free_address_front = next_free_address_front.load(std::memory_order_relaxed);
+        uintptr_t keep_end_front = (free_address_front + page_size - 1) & page_mask;
+        uintptr_t keep_begin_back = next_free_address_back.load(std::memory_order_relaxed) & page_mask;
+        if (keep_end_front >= keep_begin_back)
+        {
+            return;
+        }
+
+        uintptr_t committed_end_front = page_start_front + page_size;
+        uintptr_t committed_begin_back = page_start_back;
+        if (committed_end_front > committed_begin_back)
+        {
+            // The sides committed into each other - split the committed range somewhere in the unused gap
+            uintptr_t split = min(max(committed_begin_back, keep_end_front), keep_begin_back);
+            committed_end_front = split;
+            committed_begin_back = split;
+        }
+
+        size_t excess = committed - committed_target;
+
+        // Shrink the front towards its last live allocation
+        uintptr_t trimmed_end_front = committed_end_front - min(excess, committed_end_front - allocation_begin);
+        trimmed_end_front = max(trimmed_end_front & page_mask, keep_end_front);
+        size_t removed = committed_end_front - trimmed_end_front;
+        excess = removed >= excess ? 0 : excess - removed;
+
+        // Shrink the back towards its last live allocation
+        uintptr_t trimmed_begin_back = committed_begin_back;
+        if (excess > 0)
+        {
+            trimmed_begin_back = (committed_begin_back + excess + page_size - 1) & page_mask;
+            trimmed_begin_back = min(trimmed_begin_back, keep_begin_back);
+        }
+
+        size_t previously_charged = GetChargedSize();
+        if (trimmed_end_front < committed_end_front)
+        {
+            VirtualFree(reinterpret_cast<void *>(trimmed_end_front), committed_end_front - trimmed_end_front,
+                        MEM_DECOMMIT);
+        }
+        if (trimmed_begin_back > committed_begin_back)
+        {
+            VirtualFree(reinterpret_cast<void *>(committed_begin_back), trimmed_begin_back - committed_begin_back,
+                        MEM_DECOMMIT);
+        }
+
+        page_start_front = trimmed_end_front - page_size;
+        page_start_back = trimmed_begin_back;
+        budget->Release(previously_charged - GetChargedSize());
+
+        // Nothing between the two committed ranges is dirty any more, pages committed there again come zeroed. The
+        // dirty ranges have to stay within the committed ones, so the reclaimer never touches decommitted pages.
+        uintptr_t dirty_end = dirty_end_front.load(std::memory_order_relaxed);
+        uintptr_t dirty_begin = dirty_begin_back.load(std::memory_order_relaxed);
+        uintptr_t trimmed_dirty_end = min(dirty_end, trimmed_end_front);
+        uintptr_t trimmed_dirty_begin = max(dirty_begin, trimmed_begin_back);
+        if (dirty_begin < trimmed_end_front)
+        {
+            // The back used pages the front keeps, they are cleaned along with the front's
+            trimmed_dirty_end = trimmed_end_front;
+        }
+        if (dirty_end > trimmed_begin_back)
+        {
+            // The front used pages the back keeps, they are cleaned along with the back's
+            trimmed_dirty_begin = trimmed_begin_back;
+        }
+        dirty_end_front.store(trimmed_dirty_end, std::memory_order_relaxed);
+        dirty_begin_back.store(trimmed_dirty_begin, std::memory_order_relaxed);
+#else
+        (void)committed_target;
+#endif
+    }
+
+    size_t GetReservedSize()
+    {
+        return reserved_size;
+    }
+
+    // From now on, Reset() hands the used memory to `new_reclaimer`, which zeroes or decommits it in the background.
+    // A nullptr turns this off again. The reclaimer has to outlive the allocator. With two owners, both have to be idle.
+    void SetReclaimer(BackgroundReclaimer *new_reclaimer, BackgroundReclaimer::Mode mode)
+    {
+        WaitForReclaim();
+        reclaimer = new_reclaimer;
+        reclaim_job.decommit = mode == BackgroundReclaimer::DECOMMIT;
+    }
+
+    // Blocks until the reclaimer cleaned everything handed over by the last Reset().
+    // Returns false if pages the reclaimer decommitted can't be committed again yet, the next allocations retry it.
+    bool WaitForReclaim()
+    {
+        while (!reclaim_job.IsFrontDone() || !reclaim_job.IsBackDone())
+        {
+            std::this_thread::yield();
+        }
+        if (!reclaim_job.CommitUncommitted())
+        {
+            clean_end_front = allocation_begin;
+            clean_begin_back = allocation_end;
+            return false;
+        }
+        reclaim_job.front_uncommitted.Clear();
+        reclaim_job.back_uncommitted.Clear();
+        clean_end_front = allocation_end;
+        clean_begin_back = allocation_begin;
+        return true;
+    }
+
+    // Returns the size of the pages backing the allocator, which is also the granularity of commits
+    size_t GetPageSize()
+    {
+#if USING_VIRTUAL_MEMORY
+        return page_size;
+#else
+        return 0;
+#endif
+    }
+
+    // Returns `true` if the allocator got large pages (see USING_LARGE_PAGES)
+    bool IsUsingLargePages()
+    {
+#if USING_VIRTUAL_MEMORY
+        return large_pages;
+#else
+        return false;
+#endif
+    }
+
+    // Allocations which don't fit any more are served by `new_fallback` instead of failing.
+    // Must not be changed while blocks served by the previous fallback are still alive.
+    void SetOverflowFallback(const OverflowFallback &new_fallback)
+    {
+        fallback = new_fallback;
+    }
+
+    const FallbackStats &GetFallbackStatsFront()
+    {
+        return fallback_stats_front;
+    }
+
+    const FallbackStats &GetFallbackStatsBack()
+    {
+        return fallback_stats_back;
+    }
+
+    // Returns how many bytes of the reserved range are currently backed by committed pages.
+    // With two owners, both have to be idle.
+    size_t GetCommittedSize()
+    {
+#if USING_VIRTUAL_MEMORY
+        uintptr_t committed_end_front = page_start_front + page_size;
+        if (committed_end_front >= page_start_back)
+        {
+            // Both sides committed into each other, so the whole range is committed
+            return reserved_size;
+        }
+        return (committed_end_front - allocation_begin) + (allocation_end - page_start_back);
+#else
+        return reserved_size;
+#endif
+    }
+
+    // Moves the committed bytes of this allocator over to `new_budget`, which then limits all further commits.
+    // The budget has to outlive the allocator.
+    void SetCommitBudget(CommitBudget *new_budget)
+    {
+        if (is_valid)
+        {
+            size_t charged = GetChargedSize();
+            budget->Release(charged);
+            new_budget->Charge(charged);
+        }
+        budget = new_budget;
+    }
+
+    CommitBudget *GetCommitBudget()
+    {
+        return budget;
+    }
+
+#if WITH_ALLOCATION_PROFILING
+    const AllocationProfile &GetAllocationProfile()
+    {
+        return profile;
+    }
+
+    // Prints live and peak bytes, allocation counts and alignment waste per call site and end
+    void PrintAllocationProfile(FILE *out = stdout)
+    {
+        profile.Print(out);
+    }
+#endif
+  private:
+    // Placed in front of blocks served by the fallback. The live blocks of each end are linked, so pointers which
+    // weren't handed out by the fallback are never mistaken for one of its blocks.
+    struct FallbackHeader
+    {
+        // Address returned by the fallback
+        void *block;
+        size_t content_size;
+        FallbackHeader *previous;
+        FallbackHeader *next;
+    };
+
+    // The size of the reserved memory
+    // necessary because if user passes less than page size and the allocator is using virtual memory
+    // this size might not be exactly what was passed, as it has to be at least the size of a page
+    OWNER_STATE_ALIGNMENT size_t reserved_size;
+#if USING_VIRTUAL_MEMORY
+    DWORD page_size;
+    // The whole range is committed on large pages
+    bool large_pages = false;
+#endif
+    // Child allocators use memory of their parent, which they neither commit nor release
+    bool owns_memory = true;
+    // Committed bytes are accounted for in this budget
+    CommitBudget *budget = &CommitBudget::Global();
+    // No fallback by default, allocations which don't fit fail
+    OverflowFallback fallback;
+    // No reclaimer by default, Reset() leaves the memory as it is
+    BackgroundReclaimer *reclaimer = nullptr;
+    ReclaimJob reclaim_job;
+#if WITH_ALLOCATION_PROFILING
+    AllocationProfile profile;
+    // The profile is printed on the first failed allocation only, later failures are just counted
+    bool printed_profile_on_failure = false;
+#endif
+    // The start address of the allocator
+    uintptr_t allocation_begin;
+    // The end address of the allocator (for fixed size)
+    uintptr_t allocation_end;
+
+    bool is_valid = false;
+
+    // State of the front, only changed by the owner of the front
+    OWNER_STATE_ALIGNMENT uintptr_t last_data_begin_address_front;
+    // Published to the back for its overlap check
+    std::atomic<uintptr_t> next_free_address_front;
+#if USING_VIRTUAL_MEMORY
+    uintptr_t page_start_front;
+#endif
+    // Highest address the front used since the memory was last cleaned. Read by AllocateBackZeroed(), the back's
+    // claim check orders it.
+    std::atomic<uintptr_t> dirty_end_front;
+    // Memory below is known to be clean, the reclaimer is only checked when the front grows beyond it
+    uintptr_t clean_end_front;
+    FallbackStats fallback_stats_front;
+    // Live blocks the front got from the fallback, most recent first
+    FallbackHeader *fallback_blocks_front = nullptr;
+
+    // State of the back, only changed by the owner of the back
+    OWNER_STATE_ALIGNMENT uintptr_t last_data_begin_address_back;
+    // Published to the front for its overlap check
+    std::atomic<uintptr_t> next_free_address_back;
+#if USING_VIRTUAL_MEMORY
+    uintptr_t page_start_back;
+#endif
+    // Lowest address the back used since the memory was last cleaned. Read by AllocateZeroed(), the front's claim
+    // check orders it.
+    std::atomic<uintptr_t> dirty_begin_back;
+    // Memory from here on is known to be clean, the reclaimer is only checked when the back grows beyond it
+    uintptr_t clean_begin_back;
+    FallbackStats fallback_stats_back;
+    // Live blocks the back got from the fallback, most recent first
+    FallbackHeader *fallback_blocks_back = nullptr;
+
+#if WITH_ALLOCATION_PROFILING
+    void RecordAllocation(const std::source_location &site, AllocationProfile::End end, uintptr_t allocation_address,
+                          uintptr_t unaligned_address, uintptr_t aligned_address)
+    {
+        Metadata *metadata = ReadMetadata(allocation_address);
+        metadata->site_id = profile.GetSiteId(site);
+        metadata->alignment_waste = uint32_t(end == AllocationProfile::FRONT ? aligned_address - unaligned_address
+                                                                             : unaligned_address - aligned_address);
+        profile.RecordAllocation(metadata->site_id, end, metadata->content_size, metadata->alignment_waste);
+    }
+
+    void RecordFailure(const std::source_location &site, AllocationProfile::End end)
+    {
+        profile.RecordFailure(profile.GetSiteId(site), end);
+        if (!printed_profile_on_failure)
+        {
+            printed_profile_on_failure = true;
+            fprintf(stderr, "%s failed, allocation profile:\n",
+                    end == AllocationProfile::FRONT ? "Allocate" : "AllocateBack");
+            profile.Print(stderr);
+        }
+    }
+#endif
+
+#if USING_VIRTUAL_MEMORY
+    // Commits all pages between the committed range of the front and `end` with a single call.
+    // Returns false if the commit budget is exhausted or the OS failed to commit the pages.
+    bool CommitFront(uintptr_t end)
+    {
+        uintptr_t commit_begin = page_start_front + page_size;
+        uintptr_t commit_end = (end + page_size - 1) & ~(uintptr_t(page_size) - 1);
+#if WITH_TWO_OWNERS
+        // The back's range changes under our feet, so each side commits and is charged for its own range
+        size_t commit_size = commit_end - commit_begin;
+#else
+        // Pages the back committed already are neither committed nor charged again
+        size_t commit_size = max(min(commit_end, page_start_back), commit_begin) - commit_begin;
+#endif
+        if (!budget->TryCharge(commit_size))
+        {
+            // Not asserting, running into the hard limit is something the application is expected to handle
+            return false;
+        }
+
+        if (commit_size > 0 &&
+            !VirtualAlloc(reinterpret_cast<void *>(commit_begin), commit_size, MEM_COMMIT, PAGE_READWRITE))
+        {
+            budget->Release(commit_size);
+            assertm(false, "Front page commit failed!");
+            return false;
+        }
+
+        page_start_front = commit_end - page_size;
+        return true;
+    }
+
+    // Commits all pages between `begin` and the committed range of the back with a single call.
+    // Returns false if the commit budget is exhausted or the OS failed to commit the pages.
+    bool CommitBack(uintptr_t begin)
+    {
+        uintptr_t commit_begin = begin & ~(uintptr_t(page_size) - 1);
+#if WITH_TWO_OWNERS
+        // The front's range changes under our feet, so each side commits and is charged for its own range
+        uintptr_t new_pages_begin = commit_begin;
+#else
+        // Pages the front committed already are neither committed nor charged again
+        uintptr_t new_pages_begin = min(max(commit_begin, page_start_front + page_size), page_start_back);
+#endif
+        size_t commit_size = page_start_back - new_pages_begin;
+        if (!budget->TryCharge(commit_size))
+        {
+            // Not asserting, running into the hard limit is something the application is expected to handle
+            return false;
+        }
+
+        if (commit_size > 0 &&
+            !VirtualAlloc(reinterpret_cast<void *>(new_pages_begin), commit_size, MEM_COMMIT, PAGE_READWRITE))
+        {
+            budget->Release(commit_size);
+            assertm(false, "Back page commit failed!");
+            return false;
+        }
+
+        page_start_back = commit_begin;
+        return true;
+    }
+
+#if USING_LARGE_PAGES
+    // Reserves and commits `max_size`, rounded up to large pages, in one go. Updates `max_size` and the page size.
+    // Returns a nullptr if the allocator is too small for large pages, or they are not available.
+    void *AllocateLargePages(size_t &max_size)
+    {
+        size_t large_page_size = GetLargePageMinimum();
+        if (large_page_size == 0 || max_size < large_page_size || !EnableLockMemoryPrivilege())
+        {
+            return nullptr;
+        }
+
+        size_t size = (max_size + large_page_size - 1) & ~(large_page_size - 1);
+        // Everything is committed right away, so everything is charged right away
+        if (!budget->TryCharge(size))
+        {
+            return nullptr;
+        }
+
+        void *begin = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (begin == nullptr)
+        {
+            // e.g. physical memory is too fragmented to find enough large pages
+            budget->Release(size);
+            return nullptr;
+        }
+
+        max_size = size;
+        page_size = DWORD(large_page_size);
+        large_pages = true;
+        return begin;
+    }
+
+    // Large pages need the SeLockMemoryPrivilege to be enabled for the process
+    static bool EnableLockMemoryPrivilege()
+    {
+        // Only tried once per process
+        static bool enabled = []() {
+            HANDLE token;
+            if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+            {
+                return false;
+            }
+
+            TOKEN_PRIVILEGES privileges = {};
+            privileges.PrivilegeCount = 1;
+            privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+            // AdjustTokenPrivileges also succeeds if the privilege isn't held, that is only told by the last error
+            bool result = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+                          AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) &&
+                          GetLastError() == ERROR_SUCCESS;
+            CloseHandle(token);
+            return result;
+        }();
+        return enabled;
+    }
+#endif
+#endif
+
+    // Sets up the state shared by all constructors for the memory range [begin, begin + size)
+    void Initialize(void *begin, size_t size)
+    {
+        reserved_size = size;
+        // If we have a beginning, set allocator as valid
+        if (begin != nullptr)
+        {
+            is_valid = true;
+        }
+
+        // These values will stay constant throughout the object's lifetime
+        allocation_begin = reinterpret_cast<uintptr_t>(begin);
+        allocation_end = allocation_begin + size;
+
+#if USING_VIRTUAL_MEMORY
+        // Setting page starts back one fictious page so first allocations immediately trigger a new commit
+        page_start_front = allocation_begin - page_size;
+        page_start_back = allocation_end;
+        if (large_pages || !owns_memory)
+        {
+            // Everything is committed already, each side may use the whole range without committing
+            page_start_front = allocation_end - page_size;
+            page_start_back = allocation_begin;
+        }
+#endif
+
+        // Freshly committed pages are zeroed by the OS, and there is nothing to reclaim yet
+        dirty_end_front.store(allocation_begin, std::memory_order_relaxed);
+        dirty_begin_back.store(allocation_end, std::memory_order_relaxed);
+        if (!USING_VIRTUAL_MEMORY || !owns_memory)
+        {
+            // Memory from malloc or a parent allocator may hold anything
+            dirty_end_front.store(allocation_end, std::memory_order_relaxed);
+        }
+        clean_end_front = allocation_end;
+        clean_begin_back = allocation_begin;
+        reclaim_job.front_begin = reclaim_job.front_end = allocation_begin;
+        reclaim_job.back_begin = reclaim_job.back_end = allocation_end;
+        reclaim_job.front_watermark.store(allocation_begin, std::memory_order_relaxed);
+        reclaim_job.back_watermark.store(allocation_end, std::memory_order_relaxed);
+
+        // Initialize the current addresses to the edges of the allocated space
+        Reset();
+    }
+
+    // Submits everything used since the memory was last cleaned to the reclaimer. Nothing is known to be clean until
+    // the reclaimer moved its watermarks.
+    void HandOverToReclaimer()
+    {
+        WaitForReclaim();
+        uintptr_t dirty_end = dirty_end_front.load(std::memory_order_relaxed);
+        uintptr_t dirty_begin = dirty_begin_back.load(std::memory_order_relaxed);
+        if (dirty_end == allocation_begin && dirty_begin == allocation_end)
+        {
+            return;
+        }
+
+        // Where both sides used the same memory, the back takes care of it
+        reclaim_job.front_begin = allocation_begin;
+        reclaim_job.front_end = min(dirty_end, dirty_begin);
+        reclaim_job.back_begin = dirty_begin;
+        reclaim_job.back_end = allocation_end;
+        reclaim_job.front_watermark.store(reclaim_job.front_begin, std::memory_order_relaxed);
+        reclaim_job.back_watermark.store(reclaim_job.back_end, std::memory_order_relaxed);
+#if USING_VIRTUAL_MEMORY
+        // Large pages can't be decommitted, and a child doesn't decommit pages of its parent
+        reclaim_job.page_size = large_pages || !owns_memory ? 0 : page_size;
+#endif
+
+        dirty_end_front.store(allocation_begin, std::memory_order_relaxed);
+        dirty_begin_back.store(allocation_end, std::memory_order_relaxed);
+        clean_end_front = allocation_begin;
+        clean_begin_back = allocation_end;
+        reclaimer->Submit(reclaim_job);
+    }
+
+    // Reads `size` bytes at `offset` of `file` into `memory`. Synchronous handles are left with their file pointer behind
+    // the last byte read. Reads on overlapped handles (FILE_FLAG_OVERLAPPED) are waited for, no other I/O may be in
+    // flight on them, as the wait is on the handle itself.
+    // Returns false on read errors and if the file ends early.
+    static bool ReadFileAt(HANDLE file, uint64_t offset, void *memory, size_t size)
+    {
+        uint8_t *destination = static_cast<uint8_t *>(memory);
+        while (size > 0)
+        {
+            // ReadFile takes a 32 bit length, large reads are split into chunks of 1 GiB
+            DWORD chunk = DWORD(min(size, size_t(1) << 30));
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = DWORD(offset);
+            overlapped.OffsetHigh = DWORD(offset >> 32);
+            DWORD read = 0;
+            BOOL done = ReadFile(file, destination, chunk, &read, &overlapped);
+            if (!done && GetLastError() == ERROR_IO_PENDING)
+            {
+                done = GetOverlappedResult(file, &overlapped, &read, TRUE);
+            }
+            if (!done || read == 0)
+            {
+                return false;
+            }
+
+            destination += read;
+            offset += read;
+            size -= read;
+        }
+        return true;
+    }
+
+    // Clears the parts of [address, address + size) below `dirty_end` or from `dirty_begin` on
+    void ClearDirty(uintptr_t address, size_t size, uintptr_t dirty_end, uintptr_t dirty_begin)
+    {
+        uintptr_t end = address + size;
+        if (address < allocation_begin || end > allocation_end)
+        {
+            // Served by the fallback, nothing is known about that memory
+            ClearMemory(reinterpret_cast<void *>(address), size);
+            return;
+        }
+
+        if (address < dirty_end)
+        {
+            uintptr_t clear_end = min(end, dirty_end);
+            ClearMemory(reinterpret_cast<void *>(address), clear_end - address);
+            address = clear_end;
+        }
+        if (end > dirty_begin)
+        {
+            uintptr_t clear_begin = max(address, dirty_begin);
+            ClearMemory(reinterpret_cast<void *>(clear_begin), end - clear_begin);
+        }
+    }
+
+    // Waits until everything below `end` is clean. Returns false if pages the reclaimer decommitted can't be committed
+    // again.
+    bool WaitForReclaimFront(uintptr_t end)
+    {
+        while (reclaim_job.front_watermark.load(std::memory_order_acquire) < min(end, reclaim_job.front_end))
+        {
+            std::this_thread::yield();
+        }
+
+        // Up to the back's range, nothing was used since the last cleaning
+        uintptr_t clean_end = reclaim_job.front_watermark.load(std::memory_order_acquire);
+        if (clean_end >= reclaim_job.front_end)
+        {
+            clean_end = reclaim_job.back_begin;
+        }
+        if (end > clean_end)
+        {
+            // The back's range is cleaned from the other side, so all of it has to be done
+            while (!reclaim_job.IsBackDone())
+            {
+                std::this_thread::yield();
+            }
+            clean_end = allocation_end;
+        }
+        if (!reclaim_job.CommitUncommitted())
+        {
+            return false;
+        }
+        clean_end_front = clean_end;
+        return true;
+    }
+
+    // Waits until everything from `begin` on is clean. Returns false if pages the reclaimer decommitted can't be
+    // committed again.
+    bool WaitForReclaimBack(uintptr_t begin)
+    {
+        while (reclaim_job.back_watermark.load(std::memory_order_acquire) > max(begin, reclaim_job.back_begin))
+        {
+            std::this_thread::yield();
+        }
+
+        // Down to the front's range, nothing was used since the last cleaning
+        uintptr_t clean_begin = reclaim_job.back_watermark.load(std::memory_order_acquire);
+        if (clean_begin <= reclaim_job.back_begin)
+        {
+            clean_begin = reclaim_job.front_end;
+        }
+        if (begin < clean_begin)
+        {
+            // The front's range is cleaned from the other side, so all of it has to be done
+            while (!reclaim_job.IsFrontDone())
+            {
+                std::this_thread::yield();
+            }
+            clean_begin = allocation_begin;
+        }
+        if (!reclaim_job.CommitUncommitted())
+        {
+            return false;
+        }
+        clean_begin_back = clean_begin;
+        return true;
+    }
+
+    // Bytes accounted for in the commit budget, which are the committed bytes. With two owners, each side is charged
+    // for its own committed range instead, so the owners never have to look at each other's pages. Pages committed by
+    // both sides are counted twice then until the next Trim().
+    size_t GetChargedSize()
+    {
+        // The parent of a child is charged for the pages
+        if (!owns_memory)
+        {
+            return 0;
+        }
+#if USING_VIRTUAL_MEMORY && WITH_TWO_OWNERS
+        if (large_pages)
+        {
+            return reserved_size;
+        }
+        return (page_start_front + page_size - allocation_begin) + (allocation_end - page_start_back);
+#else
+        return GetCommittedSize();
+#endif
+    }
+
+    // Returns the header of the live fallback block at `address`, or nullptr if the address wasn't served by the
+    // fallback. The most recent blocks are checked first, as they are usually freed first.
+    FallbackHeader *FindFallbackBlock(uintptr_t address, FallbackHeader *blocks)
+    {
+        if (address >= allocation_begin && address < allocation_end)
+        {
+            return nullptr;
+        }
+        for (FallbackHeader *header = blocks; header != nullptr; header = header->next)
+        {
+            if (reinterpret_cast<uintptr_t>(header + 1) == address)
+            {
+                return header;
+            }
+        }
+        return nullptr;
+    }
+
+    void *AllocateFallback(size_t size, size_t alignment, bool back, FallbackStats &stats)
+    {
+        // A multiple of the alignment, so the content stays aligned
+        size_t header_space = max(alignment, sizeof(FallbackHeader));
+        void *block = fallback.allocate_function(size + header_space, alignment, back, fallback.user_data);
+        if (block == nullptr)
+        {
+            return nullptr;
+        }
+
+        uintptr_t address = reinterpret_cast<uintptr_t>(block) + header_space;
+        FallbackHeader *header = reinterpret_cast<FallbackHeader *>(address - sizeof(FallbackHeader));
+        header->block = block;
+        header->content_size = size;
+
+        FallbackHeader *&blocks = back ? fallback_blocks_back : fallback_blocks_front;
+        header->previous = nullptr;
+        header->next = blocks;
+        if (blocks != nullptr)
+        {
+            blocks->previous = header;
+        }
+        blocks = header;
+
+        stats.allocation_count++;
+        stats.total_bytes += size;
+        stats.live_bytes += size;
+        stats.peak_live_bytes = max(stats.peak_live_bytes, stats.live_bytes);
+        stats.largest_allocation = max(stats.largest_allocation, size);
+        return reinterpret_cast<void *>(address);
+    }
+
+    void FreeFallback(FallbackHeader *header, bool back, FallbackStats &stats)
+    {
+        FallbackHeader *&blocks = back ? fallback_blocks_back : fallback_blocks_front;
+        if (header->previous != nullptr)
+        {
+            header->previous->next = header->next;
+        }
+        else
+        {
+            blocks = header->next;
+        }
+        if (header->next != nullptr)
+        {
+            header->next->previous = header->previous;
+        }
+
+        stats.live_bytes -= header->content_size;
+        fallback.free_function(header->block, back, fallback.user_data);
+    }
+
+    // Frees the live fallback blocks of both ends, whatever their order
+    void FreeFallbackBlocks()
+    {
+        while (fallback_blocks_front != nullptr)
+        {
+            FreeFallback(fallback_blocks_front, false, fallback_stats_front);
+        }
+        while (fallback_blocks_back != nullptr)
+        {
+            FreeFallback(fallback_blocks_back, true, fallback_stats_back);
+        }
+    }
+
+    // Implements Allocate() and TryAllocate(). Only asserts on a lack of space if the caller can't handle it.
+    void *AllocateFromFront(size_t size, size_t alignment, bool may_fail ALLOCATION_SITE_PARAMETER)
+    {
+        uintptr_t free_address_front = next_free_address_front.load(std::memory_order_relaxed);
+        if (reinterpret_cast<void *>(free_address_front) == nullptr)
+        {
+            assertm(false, "Allocator did not allocate any memory");
+            return nullptr;
+        }
+        // Check for power of two
+        if (!alignment || (alignment & (alignment - 1)))
+        {
+            assertm(false, "Allocation only works with an alignement of the power of two");
+            return nullptr;
+        }
+
+        uintptr_t offset_address = free_address_front;
+#if WITH_DEBUG_CANARIES
+        // Making sure there is enough space to write canary
+        offset_address += sizeof(CANARY);
+#endif
+        // Making sure there is enough space to write metadata
+        offset_address += sizeof(Metadata);
+
+        uintptr_t aligned_address = Align(offset_address, alignment);
+
+        uintptr_t new_free_address_front = aligned_address + size;
+#if WITH_DEBUG_CANARIES
+        // Add canary size to get correct free address
+        new_free_address_front += sizeof(CANARY);
+#endif
+
+        // Oversize requests can't fit and might have wrapped around in the calculations above, so they aren't claimed
+        bool overlaps = size > reserved_size;
+        if (!overlaps)
+        {
+            // Claim the range before checking for an overlap, so an owner of the back can't claim it at the same time
+            next_free_address_front.store(new_free_address_front, CLAIM_ORDER);
+            overlaps = new_free_address_front > next_free_address_back.load(CHECK_ORDER);
+            if (overlaps)
+            {
+                next_free_address_front.store(free_address_front, std::memory_order_relaxed);
+            }
+        }
+        if (overlaps)
+        {
+            // Overlap -> out of space!
+            if (fallback.allocate_function != nullptr)
+            {
+                return AllocateFallback(size, alignment, false, fallback_stats_front);
+            }
+#if WITH_ALLOCATION_PROFILING
+            RecordFailure(site, AllocationProfile::FRONT);
+#endif
+            if (!may_fail)
+            {
+                assertm(false, "Allocate failed due to lack of space!");
+            }
+            return nullptr;
+        }
+
+        bool usable = true;
+#if USING_VIRTUAL_MEMORY
+        // If there is not enough space left on the committed pages, commit all pages the allocation reaches into
+        usable = new_free_address_front <= page_start_front + page_size || CommitFront(new_free_address_front);
+#endif // USING_VIRTUAL_MEMORY
+        // Memory handed to the reclaimer by Reset() can only be used once it is clean again
+        if (usable && new_free_address_front > clean_end_front)
+        {
+            usable = WaitForReclaimFront(new_free_address_front);
+        }
+        if (!usable)
+        {
+            next_free_address_front.store(free_address_front, std::memory_order_relaxed);
+            // Pages which can't be committed (e.g. due to the commit budget) are handled like a lack of space
+            if (fallback.allocate_function != nullptr)
+            {
+                return AllocateFallback(size, alignment, false, fallback_stats_front);
+            }
+#if WITH_ALLOCATION_PROFILING
+            RecordFailure(site, AllocationProfile::FRONT);
+#endif
+            return nullptr;
+        }
+        if (new_free_address_front > dirty_end_front.load(std::memory_order_relaxed))
+        {
+            dirty_end_front.store(new_free_address_front, std::memory_order_relaxed);
+        }
+
+        // Allocate using correct offeset address (provide prev address)
+        uintptr_t allocation_address = AllocateInternal(size, aligned_address, last_data_begin_address_front);
+#if WITH_ALLOCATION_PROFILING
+        // Everything between the previous free address and this allocation's metadata (and canary) is padding
+        RecordAllocation(site, AllocationProfile::FRONT, allocation_address, offset_address, aligned_address);
+#endif
+
+        // Update internal address pointers, the free address was already moved by the claim
+        last_data_begin_address_front = allocation_address;
+
+        return reinterpret_cast<void *>(allocation_address);
+    }
+
+    // Implements AllocateBack() and TryAllocateBack(). Only asserts on a lack of space if the caller can't handle it.
+    void *AllocateFromBack(size_t size, size_t alignment, bool may_fail ALLOCATION_SITE_PARAMETER)
+    {
+        uintptr_t free_address_back = next_free_address_back.load(std::memory_order_relaxed);
+        if (reinterpret_cast<void *>(free_address_back) == nullptr)
+        {
+            assertm(false, "Allocator did not allocate any memory");
+            return nullptr;
+        }
+        // Check for power of two
+
+        if (!alignment || (alignment & (alignment - 1)))
+        {
+            assertm(false, "Allocation only works with an alignement of the power of two");
+            return nullptr;
+        }
+
+        uintptr_t offset_address = free_address_back;
+
+#if WITH_DEBUG_CANARIES
+        // Making sure there is enough space to write canary
+        offset_address -= sizeof(CANARY);
+#endif
+
+        // Making sure there is enough space for the content
+        offset_address -= size;
+
+        uintptr_t aligned_address = Align(offset_address, -int64_t(alignment));
+
+        uintptr_t new_free_address_back = aligned_address - sizeof(Metadata);
+#if WITH_DEBUG_CANARIES
+        new_free_address_back -= sizeof(CANARY);
+#endif
+
+        // Oversize requests can't fit and might have wrapped around in the calculations above, so they aren't claimed
+        bool overlaps = size > reserved_size;
+        if (!overlaps)
+        {
+            // Claim the range before checking for an overlap, so an owner of the front can't claim it at the same time
+            next_free_address_back.store(new_free_address_back, CLAIM_ORDER);
+            overlaps = new_free_address_back < next_free_address_front.load(CHECK_ORDER);
+            if (overlaps)
+            {
+                next_free_address_back.store(free_address_back, std::memory_order_relaxed);
+            }
+        }
+        if (overlaps)
+        {
+            // Overlap -> out of space!
+            if (fallback.allocate_function != nullptr)
+            {
+                return AllocateFallback(size, alignment, true, fallback_stats_back);
+            }
+#if WITH_ALLOCATION_PROFILING
+            RecordFailure(site, AllocationProfile::BACK);
+#endif
+            if (!may_fail)
+            {
+                assertm(false, "AllocateBack failed due to lack of space!");
+            }
+            return nullptr;
+        }
+
+        bool usable = true;
+#if USING_VIRTUAL_MEMORY
+        // If there is not enough space left on the committed pages, commit all pages the allocation reaches into
+        usable = new_free_address_back >= page_start_back || CommitBack(new_free_address_back);
+#endif // USING_VIRTUAL_MEMORY
+        // Memory handed to the reclaimer by Reset() can only be used once it is clean again
+        if (usable && new_free_address_back < clean_begin_back)
+        {
+            usable = WaitForReclaimBack(new_free_address_back);
+        }
+        if (!usable)
+        {
+            next_free_address_back.store(free_address_back, std::memory_order_relaxed);
+            // Pages which can't be committed (e.g. due to the commit budget) are handled like a lack of space
+            if (fallback.allocate_function != nullptr)
+            {
+                return AllocateFallback(size, alignment, true, fallback_stats_back);
+            }
+#if WITH_ALLOCATION_PROFILING
+            RecordFailure(site, AllocationProfile::BACK);
+#endif
+            return nullptr;
+        }
+        if (new_free_address_back < dirty_begin_back.load(std::memory_order_relaxed))
+        {
+            dirty_begin_back.store(new_free_address_back, std::memory_order_relaxed);
+        }
+
+        // Allocate with negative alignment and correct offset address (provide prev address)
+        uintptr_t allocation_address = AllocateInternal(size, aligned_address, last_data_begin_address_back);
+#if WITH_ALLOCATION_PROFILING
+        // Everything between the end of this allocation's content (and canary) and the previous free address is padding
+        RecordAllocation(site, AllocationProfile::BACK, allocation_address, offset_address, aligned_address);
+#endif
+
+        // Update internal address pointers, the free address was already moved by the claim
+        last_data_begin_address_back = allocation_address;
+
+        return reinterpret_cast<void *>(allocation_address);
+    }
+
+    // Returns the the aligned address of the allocation
+    uintptr_t AllocateInternal(size_t size, uintptr_t aligned_address, uintptr_t previous_address)
+    {
+        // Write metadata
+        WriteMeta(aligned_address, size, previous_address);
+#if WITH_DEBUG_CANARIES
+        // Write canaries at end of content
+        WriteCanary(aligned_address + size);
+        WriteCanary(aligned_address - sizeof(Metadata) - sizeof(CANARY));
+#endif
+        return aligned_address;
+    }
+
+    void WriteMeta(uintptr_t address, size_t contentSize, uintptr_t previous_address)
+    {
+        uintptr_t metadataAddress = address - sizeof(Metadata);
+        *reinterpret_cast<Metadata *>(metadataAddress) = Metadata(contentSize, previous_address);
+    }
+
+    Metadata *ReadMetadata(uintptr_t address) const
+    {
+        return reinterpret_cast<Metadata *>(address - sizeof(Metadata));
+    }
+
+#if WITH_DEBUG_CANARIES
+    static void WriteCanary(uintptr_t address)
+    {
+        *reinterpret_cast<uint16_t *>(address) = uint16_t(CANARY);
+    }
+
+    static bool IsCanaryValid(uintptr_t address)
+    {
+        return *reinterpret_cast<uint16_t *>(address) == uint16_t(CANARY);
+    }
+#endif
+
+    // Negative alignment for AlignDown
+    uintptr_t Align(uintptr_t address, int64_t alignment)
+    {
+        return (address & ~(std::abs(alignment) - 1)) + alignment;
+    }
+};
+
+
+OverflowFallback OverflowFallback::Arena(DoubleEndedStackAllocator &arena)
+{
+    return Callback(
+        [](size_t size, size_t alignment, bool back, void *user_data) {
+            DoubleEndedStackAllocator *arena = static_cast<DoubleEndedStackAllocator *>(user_data);
+            // A full arena is just another failed allocation for the caller, not a reason to assert
+            return back ? arena->TryAllocateBack(size, alignment) : arena->TryAllocate(size, alignment);
+        },
+        [](void *memory, bool back, void *user_data) {
+            DoubleEndedStackAllocator *arena = static_cast<DoubleEndedStackAllocator *>(user_data);
+            back ? arena->FreeBack(memory) : arena->Free(memory);
+        },
+        &arena);
+}
+
+#if WITH_COROUTINES
+/**
+ * Allocates coroutine frames from a DoubleEndedStackAllocator: frames of awaited coroutines from the front, frames of
+ * detached coroutines (which usually outlive the coroutine that started them) from the back.
+ * Frames are mostly destroyed in LIFO order, but not always, e.g. when detached coroutines finish in a different order
+ * than they were started. A frame which is not the last allocation of its end is only marked as dead and freed once
+ * everything above it was freed. Frames the allocator has no space for are taken from the heap.
+ * Not thread safe, all coroutines using the same frame stack have to run on one thread.
+ **/
+class CoroutineFrameStack
+{
+  public:
+    CoroutineFrameStack(DoubleEndedStackAllocator &allocator) : allocator(allocator)
+    {
+    }
+    ~CoroutineFrameStack(void)
+    {
+        assertm(top[0] == nullptr && top[1] == nullptr, "Coroutine frames outlived their frame stack!");
+    }
+
+    CoroutineFrameStack(const CoroutineFrameStack &other) = delete;
+    CoroutineFrameStack &operator=(const CoroutineFrameStack &other) = delete;
+
+    void *AllocateFrame(size_t size, bool back)
+    {
+        size_t frame_size = sizeof(FrameHeader) + size;
+        void *memory = back ? allocator.TryAllocateBack(frame_size, alignof(FrameHeader))
+                            : allocator.TryAllocate(frame_size, alignof(FrameHeader));
+        if (memory == nullptr)
+        {
+            return AllocateHeapFrame(size);
+        }
+
+        FrameHeader *header = new (memory) FrameHeader();
+        header->stack = this;
+        header->back = back;
+        // Blocks served by the allocator's overflow fallback can be freed at any time, they don't need to wait
+        header->on_stack = back ? allocator.IsLastBack(memory) : allocator.IsLast(memory);
+        if (header->on_stack)
+        {
+            header->previous = top[back];
+            top[back] = header;
+        }
+        return header + 1;
+    }
+
+    static void *AllocateHeapFrame(size_t size)
+    {
+        FrameHeader *header = new (::operator new(sizeof(FrameHeader) + size)) FrameHeader();
+        return header + 1;
+    }
+
+    static void FreeFrame(void *frame)
+    {
+        FrameHeader *header = static_cast<FrameHeader *>(frame) - 1;
+        if (header->stack == nullptr)
+        {
+            ::operator delete(header);
+            return;
+        }
+        header->stack->ReleaseFrame(header);
+    }
+
+    // Frees dead frames which became the last allocation of their end in the meantime, e.g. because other
+    // allocations above them were freed
+    void Collect()
+    {
+        Collect(false);
+        Collect(true);
+    }
+
+    // Returns the number of dead frames which still wait for the allocations above them to be freed
+    size_t GetDeadFrameCount()
+    {
+        size_t count = 0;
+        for (FrameHeader *end_top : top)
+        {
+            for (FrameHeader *header = end_top; header != nullptr; header = header->previous)
+            {
+                count += header->dead;
+            }
+        }
+        return count;
+    }
+
+  private:
+    // Placed in front of every frame, aligned like memory from operator new so the frame is as well
+    struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) FrameHeader
+    {
+        // nullptr for frames taken from the heap
+        CoroutineFrameStack *stack = nullptr;
+        // Frame allocated before this one on the same end
+        FrameHeader *previous = nullptr;
+        bool back = false;
+        // Whether the frame is part of the allocator's stack, as opposed to a block from its overflow fallback
+        bool on_stack = false;
+        // The coroutine was destroyed, but the frame could not be freed yet
+        bool dead = false;
+    };
+
+    DoubleEndedStackAllocator &allocator;
+    // Last frame allocated on the front and on the back
+    FrameHeader *top[2] = {nullptr, nullptr};
+
+    void ReleaseFrame(FrameHeader *header)
+    {
+        if (!header->on_stack)
+        {
+            header->back ? allocator.FreeBack(header) : allocator.Free(header);
+            return;
+        }
+        header->dead = true;
+        Collect(header->back);
+    }
+
+    void Collect(bool back)
+    {
+        while (top[back] != nullptr && top[back]->dead &&
+               (back ? allocator.IsLastBack(top[back]) : allocator.IsLast(top[back])))
+        {
+            FrameHeader *header = top[back];
+            top[back] = header->previous;
+            back ? allocator.FreeBack(header) : allocator.Free(header);
+        }
+    }
+};
+
+/**
+ * Mixin for promise types which places the coroutine frame on a CoroutineFrameStack, passed as the coroutine's first
+ * parameter. Coroutines without it get their frame from the heap.
+ * `Args` are the types of the coroutine's other parameters. Taking them from the class instead of making operator new a
+ * template keeps it paired with the operator delete below, which GCC warns about otherwise (-Wmismatched-new-delete).
+ **/
+template <bool Back, class... Args> struct StackFramePromise
+{
+    static void *operator new(size_t size, CoroutineFrameStack &stack, Args &...)
+    {
+        return stack.AllocateFrame(size, Back);
+    }
+
+    static void *operator new(size_t size)
+    {
+        return CoroutineFrameStack::AllocateHeapFrame(size);
+    }
+
+    static void operator delete(void *frame, size_t)
+    {
+        CoroutineFrameStack::FreeFrame(frame);
+    }
+};
+
+// Storage of the value a StackTask returns, T has to be default constructible
+template <class T> struct StackTaskResult
+{
+    T value{};
+
+    void return_value(T result)
+    {
+        value = std::move(result);
+    }
+
+    T GetResult()
+    {
+        return std::move(value);
+    }
+};
+
+template <> struct StackTaskResult<void>
+{
+    void return_void()
+    {
+    }
+
+    void GetResult()
+    {
+    }
+};
+
+/**
+ * Lazily started coroutine with its frame on the front of a CoroutineFrameStack. It runs when it is co_awaited and
+ * resumes the awaiting coroutine when it finishes, so nested tasks allocate and free their frames in LIFO order.
+ * Use Run() to start the outermost task from regular code.
+ **/
+template <class T = void> class StackTask
+{
+  public:
+    // The part of the promise which doesn't depend on the coroutine's parameters
+    struct PromiseState : StackTaskResult<T>
+    {
+        // Resumed when this task finishes
+        std::coroutine_handle<> continuation;
+    };
+
+    // Picked by std::coroutine_traits below for coroutines taking a CoroutineFrameStack
+    template <class... Args> struct Promise : StackFramePromise<false, Args...>, PromiseState
+    {
+        StackTask get_return_object()
+        {
+            return StackTask(std::coroutine_handle<Promise>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> finished) noexcept
+            {
+                std::coroutine_handle<> continuation = finished.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept
+            {
+            }
+        };
+
+        FinalAwaiter final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+
+    // Coroutines without a CoroutineFrameStack get their frame from the heap
+    typedef Promise<> promise_type;
+
+    StackTask(StackTask &&other) noexcept : coroutine(other.coroutine), state(other.state)
+    {
+        other.coroutine = nullptr;
+    }
+    ~StackTask(void)
+    {
+        if (coroutine)
+        {
+            coroutine.destroy();
+        }
+    }
+
+    StackTask(const StackTask &other) = delete;
+    StackTask &operator=(const StackTask &other) = delete;
+    StackTask &operator=(StackTask &&other) = delete;
+
+    bool await_ready()
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting)
+    {
+        state->continuation = awaiting;
+        return coroutine;
+    }
+
+    T await_resume()
+    {
+        return state->GetResult();
+    }
+
+    // Runs the task from regular code. Only returns the result if the task did not wait for anything but other tasks.
+    T Run()
+    {
+        coroutine.resume();
+        assertm(coroutine.done(), "StackTask is still waiting for something!");
+        return state->GetResult();
+    }
+
+  private:
+    std::coroutine_handle<> coroutine;
+    // The promise of `coroutine`, its exact type depends on the coroutine's parameters
+    PromiseState *state;
+
+    template <class P>
+    explicit StackTask(std::coroutine_handle<P> coroutine) : coroutine(coroutine), state(&coroutine.promise())
+    {
+    }
+};
+
+/**
+ * Eagerly started coroutine with its frame on the back of a CoroutineFrameStack. Nobody waits for it, the frame is
+ * freed as soon as it finishes, which might be long after the coroutine which started it.
+ **/
+class DetachedTask
+{
+  public:
+    // Picked by std::coroutine_traits below for coroutines taking a CoroutineFrameStack
+    template <class... Args> struct Promise : StackFramePromise<true, Args...>
+    {
+        DetachedTask get_return_object()
+        {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void()
+        {
+        }
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+
+    // Coroutines without a CoroutineFrameStack get their frame from the heap
+    typedef Promise<> promise_type;
+};
+
+// Gives coroutines whose first parameter is a CoroutineFrameStack a promise which knows the other parameters' types
+namespace std
+{
+template <class T, class... Args> struct coroutine_traits<StackTask<T>, CoroutineFrameStack &, Args...>
+{
+    typedef typename StackTask<T>::template Promise<Args...> promise_type;
+};
+
+template <class... Args> struct coroutine_traits<DetachedTask, CoroutineFrameStack &, Args...>
+{
+    typedef DetachedTask::Promise<Args...> promise_type;
+};
+} // namespace std
+#endif
+
+/**
+ * Pool of pre-reserved arenas for job-scoped scratch memory. Jobs migrate between worker threads, so instead of binding
+ * an allocator to a thread, a job checks an arena out with Acquire() and hands it back with Release() once it finished.
+ * The free list is a lock-free stack, so any worker can acquire or release an arena without blocking.
+ * Released arenas are only reset when they are acquired again. Trim() decommits idle arenas down to a per-arena target,
+ * but never releases their reservations, so acquiring an arena never has to reserve memory.
+ **/
+class ArenaPool
+{
+  public:
+    ArenaPool(size_t arena_count, size_t arena_size, size_t committed_target) : committed_target(committed_target)
+    {
+        assertm(arena_count > 0 && arena_count < EMPTY, "Arena count out of range!");
+        // Aligned, the arenas might want their ends on separate cache lines
+        slots = static_cast<Slot *>(_aligned_malloc(sizeof(Slot) * arena_count, alignof(Slot)));
+        assertm(slots != nullptr, "Malloc failed!");
+        if (slots == nullptr)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < arena_count; i++)
+        {
+            new (&slots[i]) Slot(arena_size);
+            // Arenas which could not reserve their memory are never handed out
+            if (slots[i].arena.IsValid())
+            {
+                Push(uint32_t(i));
+            }
+        }
+        slot_count = arena_count;
+    }
+    ~ArenaPool(void)
+    {
+        for (size_t i = 0; i < slot_count; i++)
+        {
+            slots[i].~Slot();
+        }
+        _aligned_free(slots);
+    }
+
+    // The arenas hand out pointers into their own reservation, so the pool can't be copied or moved either
+    ArenaPool(const ArenaPool &other) = delete;
+    ArenaPool(ArenaPool &&other) = delete;
+    ArenaPool &operator=(const ArenaPool &other) = delete;
+    ArenaPool &operator=(const ArenaPool &&other) = delete;
+
+    // Checks out an empty arena. May be called from any thread.
+    // Returns a nullptr if all arenas are checked out.
+    DoubleEndedStackAllocator *Acquire()
+    {
+        uint32_t index = Pop();
+        if (index == EMPTY)
+        {
+            return nullptr;
+        }
+
+        Slot &slot = slots[index];
+        if (slot.needs_reset)
+        {
+            slot.arena.Reset();
+            slot.needs_reset = false;
+        }
+        return &slot.arena;
+    }
+
+    // Returns an arena obtained from Acquire(). May be called from any thread, not just the one which acquired it.
+    // All memory of the arena is considered freed.
+    void Release(DoubleEndedStackAllocator *arena)
+    {
+        // The arena is the first member of its slot
+        Slot *slot = reinterpret_cast<Slot *>(arena);
+        if (slot < slots || slot >= slots + slot_count)
+        {
+            assertm(false, "Arena does not belong to this pool!");
+            return;
+        }
+
+        // Resetting is deferred until the arena is acquired again
+        slot->needs_reset = true;
+        Push(uint32_t(slot - slots));
+    }
+
+    // Resets all idle arenas and decommits them down to the committed target.
+    // Meant to be called when the scheduler is idle, arenas that are being trimmed are briefly unavailable to
+    // Acquire().
+    void Trim()
+    {
+        // Take all idle arenas off the free list so nobody can acquire them while they are trimmed
+        uint32_t trimmed = EMPTY;
+        for (uint32_t index = Pop(); index != EMPTY; index = Pop())
+        {
+            Slot &slot = slots[index];
+            if (slot.needs_reset)
+            {
+                slot.arena.Reset();
+                slot.needs_reset = false;
+            }
+            slot.arena.Trim(committed_target);
+
+            slot.next.store(trimmed, std::memory_order_relaxed);
+            trimmed = index;
+        }
+
+        while (trimmed != EMPTY)
+        {
+            uint32_t next = slots[trimmed].next.load(std::memory_order_relaxed);
+            Push(trimmed);
+            trimmed = next;
+        }
+    }
+
+    size_t GetArenaCount()
+    {
+        return slot_count;
+    }
+
+  private:
+    static const uint32_t EMPTY = 0xFFFFFFFF;
+
+    struct Slot
+    {
+        Slot(size_t arena_size) : arena(arena_size)
+        {
+        }
+        // Has to stay the first member, Release() maps arenas back to their slots with it
+        DoubleEndedStackAllocator arena;
+        // Index of the next idle slot while this slot is on the free list
+        std::atomic<uint32_t> next{EMPTY};
+        // Written before the slot is pushed and read after it was popped, the free list orders these accesses
+        bool needs_reset = false;
+    };
+
+    Slot *slots = nullptr;
+    size_t slot_count = 0;
+    size_t committed_target;
+
+    // Top of the free list: the lower 32 bits are the slot index, the upper 32 bits a tag which is incremented on every
+    // change so a stale head can't be swapped back in (ABA problem)
+    std::atomic<uint64_t> free_head{EMPTY};
+
+    void Push(uint32_t index)
+    {
+        uint64_t head = free_head.load(std::memory_order_relaxed);
+        uint64_t new_head;
+        do
+        {
+            slots[index].next.store(uint32_t(head), std::memory_order_relaxed);
+            new_head = (((head >> 32) + 1) << 32) | index;
+        } while (
+            !free_head.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    uint32_t Pop()
+    {
+        uint64_t head = free_head.load(std::memory_order_acquire);
+        uint64_t new_head;
+        do
+        {
+            uint32_t index = uint32_t(head);
+            if (index == EMPTY)
+            {
+                return EMPTY;
+            }
+            // The slot might be popped and pushed by another thread meanwhile, the tag makes the exchange fail then
+            uint32_t next = slots[index].next.load(std::memory_order_relaxed);
+            new_head = (((head >> 32) + 1) << 32) | next;
+        } while (
+            !free_head.compare_exchange_weak(head, new_head, std::memory_order_acquire, std::memory_order_acquire));
+
+        return uint32_t(head);
+    }
+};
+
+
+#if WITH_ALLOCATION_PROFILING
+// WITH_ALLOCATION_PROFILING is only defined after the namespace above, so the profiling tests have to live here
+namespace Tests
+{
+    // Checks if allocations are attributed to their call sites and ends
+    template <class A> bool VerifyAllocationProfile(A &allocator, size_t size, size_t alignment)
+    {
+        void *mem = allocator.Allocate(size, alignment);
+        allocator.Allocate(size, alignment);
+        allocator.AllocateBack(size, alignment);
+        allocator.AllocateBack(size, alignment);
+        allocator.Free(allocator.Allocate(size, alignment));
+
+        const auto &profile = allocator.GetAllocationProfile();
+        typedef std::decay_t<decltype(profile)> Profile;
+        if (profile.GetSiteCount() != 5)
         {
-            assertm(false, "First Canary was overwritten - the memory is corrupted!");
-            is_valid = false;
-            return;
+            printf("[Error]: Call sites were not told apart!\n");
+            return false;
         }
 
-        // Check if content size was overwritten
-        if (last_data_begin_address_front + metadata->content_size > allocation_end)
+        const auto &first = profile.GetStats(0, Profile::FRONT);
+        const auto &last = profile.GetStats(4, Profile::FRONT);
+        if (first.live_bytes != size || first.allocation_count != 1 || last.live_bytes != 0 ||
+            last.peak_live_bytes != size || profile.GetStats(2, Profile::BACK).live_count != 1)
         {
-            assertm(false, "Metadata was overwritten - the memory is corrupted!");
-            is_valid = false;
-            return;
+            printf("[Error]: Statistics are wrong!\n");
+            return false;
         }
 
-        // Check canary after
-        if (!IsCanaryValid(last_data_begin_address_front + metadata->content_size))
+        (void)mem;
+        return true;
+    }
+} // namespace Tests
+#endif
+
+#if WITH_TWO_OWNERS
+// Same as for the profiling tests, WITH_TWO_OWNERS isn't known yet in the first Tests namespace
+namespace Tests
+{
+    // Checks if one thread on the front and another one on the back never hand out overlapping memory
+    template <class A> bool VerifyTwoOwners(A &allocator, size_t max_count, size_t alignment)
+    {
+        std::atomic<bool> overlap{false};
+        auto owner = [&](bool front) {
+            uint8_t pattern = front ? 0xAA : 0x55;
+            for (size_t round = 0; round < 2000; round++)
+            {
+                void *blocks[64];
+                size_t sizes[64];
+                size_t count = 1 + round % max_count;
+                size_t allocated = 0;
+                for (; allocated < count; allocated++)
+                {
+                    sizes[allocated] = 16 + (round * 7 + allocated * 13) % 200;
+                    blocks[allocated] = front ? allocator.Allocate(sizes[allocated], alignment)
+                                              : allocator.AllocateBack(sizes[allocated], alignment);
+                    if (blocks[allocated] == nullptr)
+                    {
+                        break;
+                    }
+                    memset(blocks[allocated], pattern, sizes[allocated]);
+                }
+                while (allocated > 0)
+                {
+                    allocated--;
+                    uint8_t *bytes = static_cast<uint8_t *>(blocks[allocated]);
+                    for (size_t i = 0; i < sizes[allocated]; i++)
+                    {
+                        if (bytes[i] != pattern)
+                        {
+                            overlap = true;
+                        }
+                    }
+                    front ? allocator.Free(blocks[allocated]) : allocator.FreeBack(blocks[allocated]);
+                }
+            }
+        };
+
+        std::thread front_owner(owner, true);
+        std::thread back_owner(owner, false);
+        front_owner.join();
+        back_owner.join();
+
+        if (overlap || !allocator.IsValid())
         {
-            assertm(false, "Second Canary was overwritten - the memory is corrupted!");
-            is_valid = false;
-            return;
+            printf("[Error]: Front and back overlapped!\n");
+            return false;
         }
 
-        // Check validity of previous address with canaries
-        // Check if address is outside allocator range
-        if (previous_address > allocation_end || previous_address < allocation_begin)
+        return true;
+    }
+} // namespace Tests
+#endif
+
+#if WITH_COROUTINES
+// The coroutines have to be defined after the task types, so these tests can't live in the namespace above
+namespace Tests
+{
+    // Resumes all coroutines waiting for it when Trigger() is called
+    struct Event
+    {
+        std::coroutine_handle<> waiting[8];
+        size_t waiting_count = 0;
+
+        bool await_ready()
         {
-            assertm(false, "Metadata was overwritten - the memory is corrupted!");
-            is_valid = false;
-            return;
+            return false;
         }
 
-        // Canary before prev address
-        if (previous_address - sizeof(Metadata) - sizeof(CANARY) < allocation_begin ||
-            !IsCanaryValid(previous_address - sizeof(Metadata) - sizeof(CANARY)))
+        void await_suspend(std::coroutine_handle<> coroutine)
         {
-            assertm(false, "Metadata was overwritten - the memory is corrupted!");
-            is_valid = false;
-            return;
+            waiting[waiting_count++] = coroutine;
         }
 
-        // Canary after prev address
-        if (previous_address + previous_metadata->content_size > allocation_end ||
-            !IsCanaryValid(previous_address + previous_metadata->content_size))
+        void await_resume()
         {
-            assertm(false, "Metadata was overwritten - the memory is corrupted!");
-            is_valid = false;
-            return;
         }
-#endif
 
-        // If beginning reached, set free address to beginning
-        if (previous_address == allocation_begin)
+        void Trigger(size_t index)
         {
-            last_data_begin_address_front = allocation_begin;
-            next_free_address_front = allocation_begin;
-            return;
+            waiting[index].resume();
         }
+    };
 
-        // Set current to previous address
-        last_data_begin_address_front = metadata->previous_address;
+    StackTask<int> Leaf(CoroutineFrameStack &, int value)
+    {
+        co_return value;
+    }
 
-        // Add data size from new front
-        next_free_address_front = last_data_begin_address_front + previous_metadata->content_size;
+    StackTask<int> Sum(CoroutineFrameStack &stack, int depth)
+    {
+        if (depth == 0)
+        {
+            co_return co_await Leaf(stack, 1);
+        }
+        co_return co_await Sum(stack, depth - 1) + co_await Leaf(stack, 1);
+    }
 
-#if WITH_DEBUG_CANARIES
-        // Add Canary
-        next_free_address_front += sizeof(CANARY);
-#endif
+    DetachedTask WaitAndCount(CoroutineFrameStack &, Event &event, int &finished)
+    {
+        co_await event;
+        finished++;
     }
 
-    // LIFO is assumed.
-    // Frees the given memory by moving the internal back addresses
-    void FreeBack(void *memory)
+    // Checks if nested task frames come from the front and are all freed again
+    bool VerifyCoroutineFramesLifo(DoubleEndedStackAllocator &allocator)
     {
-        // Is there anything to free?
-        if (last_data_begin_address_back == allocation_end)
+        void *before = allocator.Allocate(8, 8);
+        allocator.Free(before);
         {
-            assertm(false, "Cannot free an empty back");
-            return;
+            CoroutineFrameStack stack(allocator);
+            if (Sum(stack, 8).Run() != 9)
+            {
+                printf("[Error]: Coroutines returned a wrong result!\n");
+                return false;
+            }
         }
 
-        // Is the user calling LIFO as intended?
-        uintptr_t address = reinterpret_cast<uintptr_t>(memory);
-        if (address != last_data_begin_address_back)
+        if (allocator.Allocate(8, 8) != before)
         {
-            assertm(false, "FreeBack must be called LIFO!");
-            return;
+            printf("[Error]: Coroutine frames were not freed!\n");
+            return false;
         }
 
-        Metadata *metadata = ReadMetadata(last_data_begin_address_back);
-        uintptr_t previous_address = metadata->previous_address;
-        Metadata *previous_metadata = ReadMetadata(previous_address);
+        return true;
+    }
 
-#if WITH_DEBUG_CANARIES
-        // Check canary before
-        if (!IsCanaryValid(last_data_begin_address_back - sizeof(Metadata) - sizeof(CANARY)))
+    // Checks if frames the allocator has no space for come from the heap instead of failing
+    bool VerifyCoroutineFramesOverflow(DoubleEndedStackAllocator &allocator)
+    {
+        void *before = allocator.Allocate(8, 8);
+        allocator.Free(before);
         {
-            assertm(false, "First Canary was overwritten - the memory is corrupted!");
-            is_valid = false;
-            return;
+            CoroutineFrameStack stack(allocator);
+            // Far more frames than fit into the allocator
+            int depth = int(allocator.GetReservedSize() / 32);
+            if (Sum(stack, depth).Run() != depth + 1)
+            {
+                printf("[Error]: Coroutines returned a wrong result!\n");
+                return false;
+            }
         }
 
-        // Check if content size was overwritten
-        if (last_data_begin_address_back + metadata->content_size > allocation_end)
+        if (allocator.Allocate(8, 8) != before)
         {
-            assertm(false, "Metadata was overwritten - the memory is corrupted!");
-            is_valid = false;
-            return;
+            printf("[Error]: Coroutine frames were not freed!\n");
+            return false;
         }
 
-        // Check canary after
-        if (!IsCanaryValid(last_data_begin_address_back + metadata->content_size))
-        {
-            assertm(false, "Second Canary was overwritten - the memory is corrupted!");
-            is_valid = false;
-            return;
-        }
+        return true;
+    }
 
-        // Check validity of previous address with canaries
-        // Check if address is outside allocator range
-        if (previous_address > allocation_end || previous_address < allocation_begin)
+    // Checks if detached coroutine frames come from the back and are freed even if they finish out of order
+    bool VerifyCoroutineFramesOutOfOrder(DoubleEndedStackAllocator &allocator)
+    {
+        void *before = allocator.AllocateBack(8, 8);
+        allocator.FreeBack(before);
+
+        CoroutineFrameStack stack(allocator);
+        Event event;
+        int finished = 0;
+        for (int i = 0; i < 3; i++)
         {
-            assertm(false, "Metadata was overwritten - the memory is corrupted!");
-            is_valid = false;
-            return;
+            WaitAndCount(stack, event, finished);
         }
 
-        // Canary before prev address
-        if (previous_address - sizeof(Metadata) - sizeof(CANARY) < allocation_begin ||
-            !IsCanaryValid(previous_address - sizeof(Metadata) - sizeof(CANARY)))
+        event.Trigger(0);
+        event.Trigger(1);
+        if (finished != 2 || stack.GetDeadFrameCount() != 2)
         {
-            assertm(false, "Metadata was overwritten - the memory is corrupted!");
-            is_valid = false;
-            return;
+            printf("[Error]: Frames below a live frame were freed!\n");
+            return false;
         }
 
-        // Canary after prev address
-        if (previous_address + previous_metadata->content_size > allocation_end ||
-            !IsCanaryValid(previous_address + previous_metadata->content_size))
+        event.Trigger(2);
+        if (finished != 3 || stack.GetDeadFrameCount() != 0 || allocator.AllocateBack(8, 8) != before)
         {
-            assertm(false, "Metadata was overwritten - the memory is corrupted!");
-            is_valid = false;
-            return;
+            printf("[Error]: Dead frames were not freed!\n");
+            return false;
         }
 
+        return true;
+    }
+} // namespace Tests
 #endif
 
-        // If end reached, set free address to end
-        if (previous_address == allocation_end)
-        {
-            last_data_begin_address_back = allocation_end;
-            next_free_address_back = allocation_end;
-            return;
-        }
+// Like the tests, the benchmarks are deactivated by default
+#define RUN_BENCHMARKS 0
 
-        // Set current to previous address
-        last_data_begin_address_back = previous_address;
+// If set to 1, the allocator benchmarks also read the thread's cycle counter and the page fault count around each
+// workload, which tell more about why a configuration is slower than the time alone
+#define WITH_BENCHMARK_COUNTERS 0
 
-        // Add data size from new back
-        next_free_address_back = last_data_begin_address_back - sizeof(Metadata);
-#if WITH_DEBUG_CANARIES
-        next_free_address_back -= sizeof(CANARY);
+#if WITH_BENCHMARK_COUNTERS
+#include <psapi.h>
 #endif
-    }
 
-    // Clear the internal state so that the whole allocator range is available again.
-    void Reset(void)
+namespace Benchmarks
+{
+    // Returns the average time one call of `work` took in nanoseconds
+    template <class F> double Measure(size_t iterations, F &&work)
     {
-        // Reset the pointers to the outer edges of the allocation
-        last_data_begin_address_front = allocation_begin;
-        last_data_begin_address_back = allocation_end;
-
-        next_free_address_front = allocation_begin;
-        next_free_address_back = allocation_end;
-
-#if USING_VIRTUAL_MEMORY
-        // Setting page starts back one fictious page so first allocations immediately trigger a new commit
-        page_start_front = allocation_begin - page_size;
-        page_start_back = allocation_end;
-#endif
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+        {
+            work(i);
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / double(iterations);
     }
 
-    size_t GetReservedSize()
+    void Report(const char *name, double nanoseconds)
     {
-        return reserved_size;
+        printf("[%s] %.1f ns\n", name, nanoseconds);
     }
-  private:
-    // The size of the reserved memory
-    // necessary because if user passes less than page size and the allocator is using virtual memory
-    // this size might not be exactly what was passed, as it has to be at least the size of a page
-    size_t reserved_size;
-#if USING_VIRTUAL_MEMORY
-    DWORD page_size;
-    uintptr_t page_start_front;
-    uintptr_t page_start_back;
-#endif
-    // The start address of the allocator
-    uintptr_t allocation_begin;
-    // The end address of the allocator (for fixed size)
-    uintptr_t allocation_end;
 
-    uintptr_t last_data_begin_address_front;
-    uintptr_t last_data_begin_address_back;
+#if WITH_BENCHMARK_COUNTERS
+    // Windows doesn't give user mode access to hardware events like cache or dTLB misses (they need a kernel driver or
+    // an ETW session with profile sources), so the counters are the ones the kernel tracks anyway
+    struct Counters
+    {
+        // Cycles the thread spent running, including time in the kernel (e.g. committing pages)
+        uint64_t cycles = 0;
+        // Soft and hard page faults of the whole process, first touches of committed pages show up here
+        uint64_t page_faults = 0;
+    };
 
-    uintptr_t next_free_address_front;
-    uintptr_t next_free_address_back;
+    Counters ReadCounters()
+    {
+        Counters counters;
+        ULONG64 cycles = 0;
+        QueryThreadCycleTime(GetCurrentThread(), &cycles);
+        counters.cycles = cycles;
 
-    bool is_valid = false;
+        PROCESS_MEMORY_COUNTERS memory_counters = {};
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &memory_counters, sizeof(memory_counters)))
+        {
+            counters.page_faults = memory_counters.PageFaultCount;
+        }
+        return counters;
+    }
+#endif
 
-    // Returns the the aligned address of the allocation
-    uintptr_t AllocateInternal(size_t size, uintptr_t aligned_address, uintptr_t previous_address)
+    // Like Measure, but reports the time and, with WITH_BENCHMARK_COUNTERS, the counters of `work`
+    template <class F> void MeasureAndReport(const char *name, size_t iterations, F &&work)
     {
-        // Write metadata
-        WriteMeta(aligned_address, size, previous_address);
-#if WITH_DEBUG_CANARIES
-        // Write canaries at end of content
-        WriteCanary(aligned_address + size);
-        WriteCanary(aligned_address - sizeof(Metadata) - sizeof(CANARY));
+#if WITH_BENCHMARK_COUNTERS
+        Counters before = ReadCounters();
+#endif
+        double nanoseconds = Measure(iterations, work);
+#if WITH_BENCHMARK_COUNTERS
+        Counters after = ReadCounters();
+        // Page faults are rare enough to be reported in total
+        printf("[%s] %.1f ns, %.1f cycles, %llu page faults\n", name, nanoseconds,
+               double(after.cycles - before.cycles) / double(iterations),
+               (unsigned long long)(after.page_faults - before.page_faults));
+#else
+        Report(name, nanoseconds);
 #endif
-        return aligned_address;
     }
 
-    void WriteMeta(uintptr_t address, size_t contentSize, uintptr_t previous_address)
+    // Fills a fresh allocator from the front, the back or alternating between both and frees everything again, in
+    // rounds. The first round commits and touches the pages, the others reuse them. Reports the cost per allocation
+    // together with the compile time configuration, as canaries and virtual memory can't be switched at runtime.
+    void AllocatorWorkloads()
     {
-        uintptr_t metadataAddress = address - sizeof(Metadata);
-        *reinterpret_cast<Metadata *>(metadataAddress) = Metadata(contentSize, previous_address);
+        const size_t rounds = 1000;
+        const size_t blocks = 1024;
+        const size_t size = 64;
+        const size_t alignment = 16;
+        static void *addresses[blocks];
+
+        printf("[Configuration] canaries %d, virtual memory %d, large pages %d\n", WITH_DEBUG_CANARIES,
+               USING_VIRTUAL_MEMORY, USING_LARGE_PAGES);
+
+        const char *names[] = {"Front allocations", "Back allocations", "Mixed allocations"};
+        for (size_t workload = 0; workload < 3; workload++)
+        {
+            DoubleEndedStackAllocator allocator(4u * blocks * size);
+            // Alternates between front and back in the mixed workload
+            auto is_back = [&](size_t block) { return workload == 1 || (workload == 2 && block % 2 == 1); };
+
+            MeasureAndReport(names[workload], rounds * blocks, [&](size_t i) {
+                size_t block = i % blocks;
+                void *address = nullptr;
+                if (is_back(block))
+                {
+                    address = allocator.AllocateBack(size, alignment);
+                }
+                else
+                {
+                    address = allocator.Allocate(size, alignment);
+                }
+                // Touching the memory is what faults committed pages in
+                memset(address, 0, size);
+                addresses[block] = address;
+
+                if (block != blocks - 1)
+                {
+                    return;
+                }
+                // Last allocation of the round, free all in reverse
+                for (size_t j = blocks; j-- > 0;)
+                {
+                    if (is_back(j))
+                    {
+                        allocator.FreeBack(addresses[j]);
+                    }
+                    else
+                    {
+                        allocator.Free(addresses[j]);
+                    }
+                }
+            });
+        }
     }
 
-    Metadata *ReadMetadata(uintptr_t address) const
+#if WITH_COROUTINES
+    StackTask<size_t> Frame(CoroutineFrameStack &stack, size_t depth)
     {
-        return reinterpret_cast<Metadata *>(address - sizeof(Metadata));
+        if (depth == 0)
+        {
+            co_return 1;
+        }
+        co_return co_await Frame(stack, depth - 1) + 1;
     }
 
-#if WITH_DEBUG_CANARIES
-    static void WriteCanary(uintptr_t address)
+    StackTask<size_t> HeapFrame(size_t depth)
     {
-        *reinterpret_cast<uint16_t *>(address) = uint16_t(CANARY);
+        if (depth == 0)
+        {
+            co_return 1;
+        }
+        co_return co_await HeapFrame(depth - 1) + 1;
     }
 
-    static bool IsCanaryValid(uintptr_t address)
+    // Creates and destroys chains of nested coroutines, once with their frames on a CoroutineFrameStack and once on the
+    // heap, and reports the time per frame
+    void CoroutineFrames()
     {
-        return *reinterpret_cast<uint16_t *>(address) == uint16_t(CANARY);
+        const size_t iterations = 200000;
+        const size_t depth = 8;
+        DoubleEndedStackAllocator allocator(1024u * 1024u);
+        CoroutineFrameStack stack(allocator);
+        size_t frames = 0;
+
+        double stack_time = Measure(iterations, [&](size_t) { frames += Frame(stack, depth - 1).Run(); });
+        double heap_time = Measure(iterations, [&](size_t) { frames += HeapFrame(depth - 1).Run(); });
+
+        Report("Coroutine frame on stack allocator", stack_time / depth);
+        Report("Coroutine frame on heap", heap_time / depth);
+        // Keeps the compiler from optimizing the coroutines away
+        assertm(frames == 2 * iterations * depth, "Coroutines returned a wrong result!");
     }
 #endif
 
-    // Negative alignment for AlignDown
-    uintptr_t Align(uintptr_t address, int64_t alignment)
+    // Compares ways to get zeroed memory: Allocate() + memset, AllocateZeroed() and calloc. Once with memory which was
+    // used before and has to be cleared, and once with pages which were just trimmed and come zeroed from the OS when
+    // they are committed again.
+    void ZeroedAllocations()
     {
-        return (address & ~(std::abs(alignment) - 1)) + alignment;
+        const size_t sizes[] = {256, 64 * 1024, 4 * 1024 * 1024};
+        const size_t alignment = 16;
+        DoubleEndedStackAllocator allocator(16u * 1024u * 1024u);
+        // Keeps the compiler from optimizing the clearing away
+        size_t sum = 0;
+        char name[64];
+
+        for (size_t size : sizes)
+        {
+            const size_t iterations = max(size_t(16), 64u * 1024u * 1024u / size);
+            for (int trimmed = 0; trimmed < 2; trimmed++)
+            {
+                // Without virtual memory, there is nothing to trim
+                if (trimmed && !USING_VIRTUAL_MEMORY)
+                {
+                    continue;
+                }
+                const char *state = trimmed ? "trimmed" : "used";
+
+                snprintf(name, sizeof(name), "Allocate + memset %zu B, %s", size, state);
+                MeasureAndReport(name, iterations, [&](size_t) {
+                    uint8_t *memory = static_cast<uint8_t *>(allocator.Allocate(size, alignment));
+                    memset(memory, 0, size);
+                    sum += memory[size - 1];
+                    allocator.Free(memory);
+                    if (trimmed)
+                    {
+                        allocator.Trim(0);
+                    }
+                });
+
+                snprintf(name, sizeof(name), "AllocateZeroed %zu B, %s", size, state);
+                MeasureAndReport(name, iterations, [&](size_t) {
+                    uint8_t *memory = static_cast<uint8_t *>(allocator.AllocateZeroed(size, alignment));
+                    sum += memory[size - 1];
+                    allocator.Free(memory);
+                    if (trimmed)
+                    {
+                        allocator.Trim(0);
+                    }
+                });
+            }
+
+            snprintf(name, sizeof(name), "calloc %zu B", size);
+            MeasureAndReport(name, iterations, [&](size_t) {
+                uint8_t *memory = static_cast<uint8_t *>(calloc(size, 1));
+                // Read through volatile, otherwise the compiler knows the result and drops calloc entirely
+                sum += static_cast<volatile uint8_t *>(memory)[size - 1];
+                free(memory);
+            });
+        }
+        assertm(sum == 0, "Zeroed memory was not zero!");
+        (void)sum;
     }
-};
 
+    void Run()
+    {
+        AllocatorWorkloads();
+        ZeroedAllocations();
+#if WITH_COROUTINES
+        CoroutineFrames();
+#endif
+    }
+} // namespace Benchmarks
 
 //Deactivating own tests, as they would trigger asserts when using debug build (as they should) which might interfere with your tests
 #define RUN_TESTS 0
@@ -928,10 +4001,99 @@ int main()
         DoubleEndedStackAllocator f(1024u);
         Tests::Test_Case_Success("Metadata address overwritten", Tests::VerifyMetadataPrevAddressOverwritten(f, 32, 8));
         DoubleEndedStackAllocator g(1024u);
-        Tests::Test_Case_Success("Metadata back size overwritten", Tests::VerifyBackMetadataSizeOverwritten(f, 32, 8));
+        Tests::Test_Case_Success("Metadata back size overwritten", Tests::VerifyBackMetadataSizeOverwritten(g, 32, 8));
         DoubleEndedStackAllocator h(1024u);
         Tests::Test_Case_Success("Metadata back address overwritten",
-                                 Tests::VerifyBackMetadataPrevAddressOverwritten(f, 32, 8));
+                                 Tests::VerifyBackMetadataPrevAddressOverwritten(h, 32, 8));
+#endif
+
+        ArenaPool pool(4, 1024u * 1024u, 0);
+        Tests::Test_Case_Success("ArenaPool reuses released arenas", Tests::VerifyArenaPoolReuse(pool, 32, 8));
+#if USING_VIRTUAL_MEMORY
+        // Trimming and commit budgets only make a difference with virtual memory
+        ArenaPool trim_pool(1, 1024u * 1024u, 0);
+        Tests::Test_Case_Success("ArenaPool trims idle arenas", Tests::VerifyArenaPoolTrim(trim_pool, 64u * 1024u, 8));
+
+        // The budget has to outlive the allocator using it
+        CommitBudget budget(64u * 1024u, 32u * 1024u);
+        DoubleEndedStackAllocator budgeted(1024u * 1024u);
+        Tests::Test_Case_Success("Commit budget limits allocations",
+                                 Tests::VerifyCommitBudget(budgeted, budget, 10u * 1024u, 8));
+#if !WITH_TWO_OWNERS
+        // With two owners, pages committed by both ends are charged twice on purpose
+        CommitBudget exact_budget(1024u * 1024u);
+        DoubleEndedStackAllocator both_ends(1024u * 1024u);
+        Tests::Test_Case_Success("Pages used by both ends are charged once",
+                                 Tests::VerifyCommitBudgetSharedPages(both_ends, exact_budget, 8));
+#endif
+        CommitBudget fallback_budget(64u * 1024u);
+        DoubleEndedStackAllocator budgeted_with_fallback(1024u * 1024u);
+        Tests::Test_Case_Success("Commit budget overflow is served by malloc",
+                                 Tests::VerifyCommitBudgetFallback(budgeted_with_fallback, fallback_budget,
+                                                                   OverflowFallback::Malloc(), 10u * 1024u, 8));
+#endif
+
+        DoubleEndedStackAllocator large(8u * 1024u * 1024u);
+        Tests::Test_Case_Success("Allocations spanning many pages", Tests::VerifyLargeAllocations(large, 64));
+
+        BackgroundReclaimer reclaimer;
+        DoubleEndedStackAllocator zeroed(4u * 1024u * 1024u);
+        Tests::Test_Case_Success("Reset memory is zeroed in the background",
+                                 Tests::VerifyBackgroundReclaim(zeroed, reclaimer, BackgroundReclaimer::ZERO));
+        DoubleEndedStackAllocator decommitted(4u * 1024u * 1024u);
+        Tests::Test_Case_Success("Reset memory is decommitted in the background",
+                                 Tests::VerifyBackgroundReclaim(decommitted, reclaimer, BackgroundReclaimer::DECOMMIT));
+        DoubleEndedStackAllocator trimmed_zeroed(1024u * 1024u);
+        Tests::Test_Case_Success("Trimmed memory is not zeroed in the background",
+                                 Tests::VerifyReclaimAfterTrim(trimmed_zeroed, reclaimer, BackgroundReclaimer::ZERO));
+        DoubleEndedStackAllocator trimmed_decommitted(1024u * 1024u);
+        Tests::Test_Case_Success(
+            "Trimmed memory is not decommitted in the background",
+            Tests::VerifyReclaimAfterTrim(trimmed_decommitted, reclaimer, BackgroundReclaimer::DECOMMIT));
+
+        DoubleEndedStackAllocator zeroed_allocations(1024u * 1024u);
+        Tests::Test_Case_Success("Zeroed allocations are zero", Tests::VerifyAllocateZeroed(zeroed_allocations, 16));
+
+        DoubleEndedStackAllocator file_allocator(1024u * 1024u);
+        Tests::Test_Case_Success("Files are read into allocations",
+                                 Tests::VerifyAllocateFromFile(file_allocator, 0, 64));
+        Tests::Test_Case_Success("Overlapped files are read into allocations",
+                                 Tests::VerifyAllocateFromFile(file_allocator, FILE_FLAG_OVERLAPPED, 64));
+
+        DoubleEndedStackAllocator parent(1024u * 1024u);
+        Tests::Test_Case_Success("Child allocators use blocks of their parent",
+                                 Tests::VerifyChildAllocators(parent, 16));
+
+        DoubleEndedStackAllocator overflowing(1024u);
+        Tests::Test_Case_Success("Overflow is served by malloc",
+                                 Tests::VerifyOverflowFallback(overflowing, OverflowFallback::Malloc(), 16));
+        DoubleEndedStackAllocator overflowing_arena(1024u);
+        DoubleEndedStackAllocator larger_arena(1024u * 1024u);
+        Tests::Test_Case_Success(
+            "Overflow is served by a larger arena",
+            Tests::VerifyOverflowFallback(overflowing_arena, OverflowFallback::Arena(larger_arena), 16));
+
+#if WITH_TWO_OWNERS
+        // Small enough for the ends to run into each other all the time
+        DoubleEndedStackAllocator shared(8u * 1024u);
+        Tests::Test_Case_Success("Front and back owned by different threads", Tests::VerifyTwoOwners(shared, 48, 8));
+#endif
+
+#if WITH_COROUTINES
+        DoubleEndedStackAllocator coroutine_frames(64u * 1024u);
+        Tests::Test_Case_Success("Coroutine frames are freed LIFO",
+                                 Tests::VerifyCoroutineFramesLifo(coroutine_frames));
+        Tests::Test_Case_Success("Detached coroutine frames are freed out of order",
+                                 Tests::VerifyCoroutineFramesOutOfOrder(coroutine_frames));
+        DoubleEndedStackAllocator few_coroutine_frames(4096u);
+        Tests::Test_Case_Success("Coroutine frames which don't fit come from the heap",
+                                 Tests::VerifyCoroutineFramesOverflow(few_coroutine_frames));
+#endif
+
+#if WITH_ALLOCATION_PROFILING
+        DoubleEndedStackAllocator profiled(1024u);
+        Tests::Test_Case_Success("Allocations are attributed to call sites",
+                                 Tests::VerifyAllocationProfile(profiled, 32, 8));
 #endif
 
         Tests::Test_Case_Failure("Allocate() does not return nullptr",
@@ -941,6 +4103,10 @@ int main()
     }
 #endif
 
+#if RUN_BENCHMARKS
+    Benchmarks::Run();
+#endif
+
     // Here the assignment tests will happen - it will test basic allocator functionality.
     {
     }